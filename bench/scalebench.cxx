@@ -0,0 +1,155 @@
+/*
+ * scalebench.cxx - part of SpiritVNC - FLTK
+ * 2016-2021 Will Brokenbourgh https://www.pismotek.com/brainout/
+ */
+
+/*
+ * (C) Will Brokenbourgh
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of
+ * conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of
+ * conditions and the following disclaimer in the documentation and/or other materials provided
+ * with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used
+ * to endorse or promote products derived from this software without specific prior written
+ * permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * scalebench - times the viewer's scaling kernels at each level against
+ * FLTK's Fl_RGB_Image::copy() bilinear path
+ *
+ * usage: scalebench [srcW srcH dstW dstH [iterations]]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+
+#include <FL/Fl.H>
+#include <FL/Fl_RGB_Image.H>
+
+#include "../src/scale.h"
+
+
+/* monotonic time in milliseconds */
+static double benchNow ()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+
+/* time a full-image scale at the given kernel level, returning ms per frame */
+static double benchKernel (int nLevel, const unsigned char * src, int srcW, int srcH,
+    unsigned char * dst, int dstW, int dstH, int bpp, bool fast, int nIters)
+{
+    svScaleSetLevel(nLevel);
+
+    double dStart = benchNow();
+
+    for (int i = 0; i < nIters; i ++)
+        svScaleImageRect(src, srcW, srcH, dst, dstW, dstH, bpp, 0, 0, dstW, dstH, fast, NULL);
+
+    return (benchNow() - dStart) / nIters;
+}
+
+
+int main (int argc, char **argv)
+{
+    int srcW = 1920;
+    int srcH = 1080;
+    int dstW = 1280;
+    int dstH = 720;
+    int nIters = 50;
+
+    if (argc >= 5)
+    {
+        srcW = atoi(argv[1]);
+        srcH = atoi(argv[2]);
+        dstW = atoi(argv[3]);
+        dstH = atoi(argv[4]);
+    }
+
+    if (argc >= 6)
+        nIters = atoi(argv[5]);
+
+    if (srcW < 1 || srcH < 1 || dstW < 1 || dstH < 1 || nIters < 1)
+    {
+        fprintf(stderr, "usage: scalebench [srcW srcH dstW dstH [iterations]]\n");
+        return 1;
+    }
+
+    std::vector<unsigned char> src(srcW * srcH * 4);
+    std::vector<unsigned char> ref(dstW * dstH * 4);
+    std::vector<unsigned char> dst(dstW * dstH * 4);
+
+    srand(1);
+
+    for (size_t i = 0; i < src.size(); i ++)
+        src[i] = static_cast<unsigned char>(rand());
+
+    int nBest = svScaleSetLevel(SV_SCALE_AUTO);
+
+    printf("%dx%d -> %dx%d, %d iterations, best level: %s\n\n", srcW, srcH, dstW, dstH,
+        nIters, svScaleLevelName(nBest));
+
+    // fltk's scaler (what the viewer used before)
+    Fl_RGB_Image::RGB_scaling(FL_RGB_SCALING_BILINEAR);
+    Fl_RGB_Image srcImage(&src[0], srcW, srcH, 4);
+
+    double dStart = benchNow();
+
+    for (int i = 0; i < nIters; i ++)
+        delete srcImage.copy(dstW, dstH);
+
+    printf("%-28s %8.2f ms\n", "fltk bilinear 32bpp", (benchNow() - dStart) / nIters);
+
+    // our kernels, checked against the scalar output
+    for (int bpp = 4; bpp >= 2; bpp -= 2)
+    {
+        for (int fast = 1; fast >= 0; fast --)
+        {
+            for (int nLevel = SV_SCALE_SCALAR; nLevel <= nBest; nLevel ++)
+            {
+                double dMs = benchKernel(nLevel, &src[0], srcW, srcH,
+                    nLevel == SV_SCALE_SCALAR ? &ref[0] : &dst[0], dstW, dstH, bpp,
+                    fast == 1, nIters);
+
+                char strName[64];
+
+                snprintf(strName, sizeof(strName), "%s %s %dbpp", svScaleLevelName(nLevel),
+                    fast == 1 ? "nearest" : "bilinear", bpp * 8);
+
+                bool bMatch = (nLevel == SV_SCALE_SCALAR
+                    || memcmp(&ref[0], &dst[0], dstW * dstH * bpp) == 0);
+
+                printf("%-28s %8.2f ms%s\n", strName, dMs, bMatch ? "" : "  ** MISMATCH **");
+            }
+        }
+    }
+
+    return 0;
+}
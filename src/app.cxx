@@ -252,15 +252,59 @@ void svConfigReadCreateHostList ()
                     app->nDeadTimeout = w;
                 }
 
-                // starting local port number for ssh
-                if (strProp == "startinglocalport")
+                // longest wait between services for hosts that aren't showing
+                if (strProp == "backgroundinterval")
                 {
                     int w = atoi(strVal.c_str());
 
-                    if (w < 1)
-                        w = 15000;
+                    if (w < 0)
+                        w = 200;
+
+                    app->nBackgroundInterval = w;
+                }
+
+                // most times a second a viewer is redrawn
+                if (strProp == "maxfps")
+                {
+                    int w = atoi(strVal.c_str());
+
+                    if (w < 0)
+                        w = 60;
+
+                    app->nMaxFps = w;
+                }
+
+                // most hosts 'connect all' sets up at once
+                if (strProp == "maxconnecting")
+                {
+                    int w = atoi(strVal.c_str());
+
+                    if (w < 0)
+                        w = 4;
+
+                    app->nMaxConnecting = w;
+                }
+
+                // longest random wait between 'connect all' starting each host
+                if (strProp == "connectjitter")
+                {
+                    int w = atoi(strVal.c_str());
+
+                    if (w < 0)
+                        w = 250;
+
+                    app->nConnectJitter = w;
+                }
+
+                // seconds between host reachability checks
+                if (strProp == "probeinterval")
+                {
+                    int w = atoi(strVal.c_str());
+
+                    if (w < 0)
+                        w = 60;
 
-                    app->nStartingLocalPort = w;
+                    app->nProbeInterval = w;
                 }
 
                 // display tooltips?
@@ -335,6 +379,14 @@ void svConfigReadCreateHostList ()
                 if (strProp == "showreverseconnect")
                     app->showReverseConnect = svConvertStringToBoolean(strVal);
 
+                // draw viewers through x11 shared memory?
+                if (strProp == "usexshm")
+                    app->useXShm = svConvertStringToBoolean(strVal);
+
+                // cut quality on hosts that aren't being viewed?
+                if (strProp == "backgroundsaver")
+                    app->backgroundSaver = svConvertStringToBoolean(strVal);
+
                 // #############################################################################
                 // ######## per-connection options #############################################
                 // #############################################################################
@@ -421,6 +473,15 @@ void svConfigReadCreateHostList ()
                 if (strProp == "f12macro")
                     itm->f12Macro = strVal;
 
+                // delay between F12 macro key events
+                if (strProp == "f12macrodelay")
+                {
+                    itm->f12MacroDelay = atoi(strVal.c_str());
+
+                    if (itm->f12MacroDelay < 0)
+                        itm->f12MacroDelay = 0;
+                }
+
                 // scaling
                 if (strProp == "scale")
                 {
@@ -430,6 +491,8 @@ void svConfigReadCreateHostList ()
                         itm->scaling = 'z';
                     else if (strVal == "s")
                         itm->scaling = 's';
+                    else if (strVal == "r")
+                        itm->scaling = 'r';
                 }
 
                 // fast scaling?
@@ -440,6 +503,21 @@ void svConfigReadCreateHostList ()
                 if (strProp == "showremotecursor")
                     itm->showRemoteCursor = svConvertStringToBoolean(strVal);
 
+                // receive pixels in the display's native format?
+                if (strProp == "nativeformat")
+                    itm->nativePixelFormat = svConvertStringToBoolean(strVal);
+
+                // preferred encodings
+                if (strProp == "encodings")
+                {
+                    std::string strDropped;
+                    itm->encodings = svCleanEncodingList(strVal, strDropped);
+                }
+
+                // adapt quality and compression to the connection?
+                if (strProp == "adaptivequality")
+                    itm->adaptiveQuality = svConvertStringToBoolean(strVal);
+
                 // compression level
                 if (strProp == "compression")
                 {
@@ -522,8 +600,8 @@ void svConfigWrite ()
     ofs << "# option names / properties should always be lower-case without"
         " spaces" << std::endl;
     ofs << "# host type can be 'v' for vnc and 's' for vnc through ssh" << std::endl;
-    ofs << "# scale can be 's' for scrolled, 'z' for scale up/down and 'f' for scale"
-        " down only" << std::endl;
+    ofs << "# scale can be 's' for scrolled, 'z' for scale up/down, 'f' for scale"
+        " down only and 'r' for resizing the remote desktop" << std::endl;
     ofs << std::endl;
 
     ofs << "# program options" << std::endl;
@@ -540,8 +618,18 @@ void svConfigWrite ()
     // dead connection timeout
     ofs << "deadtimeout=" << app->nDeadTimeout << std::endl;
 
-    // starting local port number (+99) for ssh connections
-    ofs << "startinglocalport=" << app->nStartingLocalPort << std::endl;
+    // background host service interval
+    ofs << "backgroundinterval=" << app->nBackgroundInterval << std::endl;
+
+    // viewer frame rate cap
+    ofs << "maxfps=" << app->nMaxFps << std::endl;
+
+    // 'connect all' limits
+    ofs << "maxconnecting=" << app->nMaxConnecting << std::endl;
+    ofs << "connectjitter=" << app->nConnectJitter << std::endl;
+
+    // host reachability check interval
+    ofs << "probeinterval=" << app->nProbeInterval << std::endl;
 
     // show tool tips
     ofs << "showtooltips=" << svConvertBooleanToString(app->showTooltips) << std::endl;
@@ -552,6 +640,12 @@ void svConfigWrite ()
     // show reverse-connect message
     ofs << "showreverseconnect=" << svConvertBooleanToString(app->showReverseConnect) << std::endl;
 
+    // draw viewers through x11 shared memory
+    ofs << "usexshm=" << svConvertBooleanToString(app->useXShm) << std::endl;
+
+    // cut quality on hosts that aren't being viewed
+    ofs << "backgroundsaver=" << svConvertBooleanToString(app->backgroundSaver) << std::endl;
+
     // app font size
     ofs << "appfontsize=" << app->nAppFontSize << std::endl;
 
@@ -596,9 +690,13 @@ void svConfigWrite ()
         ofs << "scale=" << itm->scaling << std::endl;
         ofs << "scalefast=" << svConvertBooleanToString(itm->scalingFast) << std::endl;
         ofs << "f12macro=" << itm->f12Macro << std::endl;
+        ofs << "f12macrodelay=" << itm->f12MacroDelay << std::endl;
         ofs << "showremotecursor=" << svConvertBooleanToString(itm->showRemoteCursor) << std::endl;
+        ofs << "nativeformat=" << svConvertBooleanToString(itm->nativePixelFormat) << std::endl;
+        ofs << "adaptivequality=" << svConvertBooleanToString(itm->adaptiveQuality) << std::endl;
         ofs << "compression=" << itm->compressLevel << std::endl;
         ofs << "quality=" << itm->qualityLevel << std::endl;
+        ofs << "encodings=" << itm->encodings << std::endl;
         ofs << "ignoreinactive=" << svConvertBooleanToString(itm->ignoreInactive) << std::endl;
         ofs << "centerx=" << svConvertBooleanToString(itm->centerX) << std::endl;
         ofs << "centery=" << svConvertBooleanToString(itm->centerY) << std::endl;
@@ -613,6 +711,225 @@ void svConfigWrite ()
 }
 
 
+/*
+ * queue every disconnected host in itmGroup's group, or in the whole list if
+ * itmGroup is NULL, to be connected by svConnectQueueTimer
+ */
+void svConnectQueueAdd (HostItem * itmGroup)
+{
+    int nSize = app->hostList->size();
+    int nAdded = 0;
+
+    for (int i = 1; i <= nSize; i ++)
+    {
+        HostItem * itm = static_cast<HostItem *>(app->hostList->data(i));
+
+        // (separators and the empty top row have no itm)
+        if (itm == NULL || itm->isListener == true || itm->hostAddress == "")
+            continue;
+
+        if (itmGroup != NULL && itm->group != itmGroup->group)
+            continue;
+
+        if (itm->isConnected == true || itm->isConnecting == true)
+            continue;
+
+        bool isQueued = false;
+
+        for (size_t j = 0; j < app->connectQueue.size(); j ++)
+            if (app->connectQueue[j] == itm)
+                isQueued = true;
+
+        if (isQueued == true)
+            continue;
+
+        app->connectQueue.push_back(itm);
+        nAdded ++;
+    }
+
+    if (nAdded == 0)
+        return;
+
+    // start a new batch if the last one is done
+    if (Fl::has_timeout(svConnectQueueTimer) == 0)
+    {
+        app->nConnectQueueTotal = 0;
+        app->nConnectQueueConnected = 0;
+        app->nConnectQueueFailed = 0;
+        app->connectQueueNextMs = 0;
+
+        Fl::add_timeout(0, svConnectQueueTimer);
+    }
+
+    app->nConnectQueueTotal += nAdded;
+
+    char strMsg[64] = {0};
+    snprintf(strMsg, sizeof(strMsg), "svConnectQueueAdd - Queued %i hosts to connect", nAdded);
+    svDebugLog(strMsg);
+
+    svConnectQueueShowProgress();
+}
+
+
+/* show how the current 'connect all' batch is going in the main window title */
+void svConnectQueueShowProgress ()
+{
+    // (the scan owns the title while it's running)
+    if (app->scanIsRunning == true)
+        return;
+
+    if (app->connectQueue.empty() == true && app->connectQueueStarted.empty() == true)
+    {
+        app->mainWin->label("SpiritVNC");
+        return;
+    }
+
+    char strLabel[128] = {0};
+
+    snprintf(strLabel, sizeof(strLabel), "SpiritVNC [Connected %i of %i, %i failed]",
+        app->nConnectQueueConnected, app->nConnectQueueTotal, app->nConnectQueueFailed);
+
+    app->mainWin->copy_label(strLabel);
+}
+
+
+/*
+ * drop the hosts 'connect all' hasn't started yet (the ones already
+ * connecting carry on)
+ */
+void svConnectQueueStop ()
+{
+    app->nConnectQueueTotal -= app->connectQueue.size();
+    app->connectQueue.clear();
+
+    svConnectQueueShowProgress();
+}
+
+
+/*
+ * start queued hosts a few at a time, each after a short random wait, so
+ * servers and ssh bastions don't get every handshake at once
+ */
+void svConnectQueueTimer (void * notUsed)
+{
+    (void) notUsed;
+
+    // count the hosts that have finished setting up, one way or the other
+    for (size_t i = 0; i < app->connectQueueStarted.size();)
+    {
+        int nState = app->connectQueueStarted[i]->connectState;
+
+        if (nState == SV_CONN_CONNECTED)
+            app->nConnectQueueConnected ++;
+        else
+        if (nState == SV_CONN_FAILED || nState == SV_CONN_IDLE)
+            app->nConnectQueueFailed ++;
+        else
+        {
+            i ++;
+            continue;
+        }
+
+        app->connectQueueStarted.erase(app->connectQueueStarted.begin() + i);
+    }
+
+    long nNow = svMonotonicMs();
+
+    while (app->connectQueue.empty() == false
+        && (app->nMaxConnecting == 0
+        || static_cast<int>(app->connectQueueStarted.size()) < app->nMaxConnecting)
+        && nNow >= app->connectQueueNextMs)
+    {
+        HostItem * itm = app->connectQueue.front();
+
+        app->connectQueue.erase(app->connectQueue.begin());
+
+        // (connected by hand since it was queued)
+        if (itm->isConnected == true || itm->isConnecting == true)
+        {
+            app->nConnectQueueTotal --;
+            continue;
+        }
+
+        VncObject::createVNCObject(itm);
+
+        app->connectQueueStarted.push_back(itm);
+
+        if (app->nConnectJitter > 0)
+            app->connectQueueNextMs = nNow + (rand() % (app->nConnectJitter + 1));
+    }
+
+    svConnectQueueShowProgress();
+
+    // all done
+    if (app->connectQueue.empty() == true && app->connectQueueStarted.empty() == true)
+    {
+        char strMsg[80] = {0};
+        snprintf(strMsg, sizeof(strMsg), "Connect all finished - %i of %i hosts connected",
+            app->nConnectQueueConnected, app->nConnectQueueTotal);
+        svLogToFile(strMsg);
+        return;
+    }
+
+    Fl::repeat_timeout(SV_CONNECT_QUEUE_TICK, svConnectQueueTimer);
+}
+
+
+/* describe a host connection state, for messages and the log */
+std::string svConnectStateName (int nState)
+{
+    switch (nState)
+    {
+        case SV_CONN_IDLE:
+            return "idle";
+        case SV_CONN_STARTING:
+            return "starting";
+        case SV_CONN_SSH_CONNECT:
+            return "connecting to the SSH server";
+        case SV_CONN_SSH_HANDSHAKE:
+            return "in the SSH handshake";
+        case SV_CONN_SSH_AUTH:
+            return "logging in to the SSH server";
+        case SV_CONN_SSH_CHANNEL:
+            return "opening the SSH channel";
+        case SV_CONN_SSH_READY:
+            return "with the SSH tunnel ready";
+        case SV_CONN_VNC_CONNECT:
+            return "connecting to the VNC server";
+        case SV_CONN_LISTENING:
+            return "waiting for the host to call";
+        case SV_CONN_RFB_INIT:
+            return "in the VNC handshake";
+        case SV_CONN_CONNECTED:
+            return "connected";
+        case SV_CONN_FAILED:
+            return "failed";
+    }
+
+    return "unknown";
+}
+
+
+/*
+ * the longest a host's connection may stay in one state, in seconds (0 for
+ * no limit).  Each setup step also gives up on its own deadline; this
+ * catches one that can't, like the rfb handshake inside libvnc
+ */
+int svConnectStateTimeout (int nState)
+{
+    switch (nState)
+    {
+        case SV_CONN_IDLE:
+        case SV_CONN_LISTENING:
+        case SV_CONN_CONNECTED:
+        case SV_CONN_FAILED:
+            return 0;
+    }
+
+    return app->nConnectionTimeout;
+}
+
+
 /* a connection 'supervisor' that is called approx. every second by a timer */
 /* (timer callback) */
 void svConnectionWatcher (void * notUsed)
@@ -647,12 +964,23 @@ void svConnectionWatcher (void * notUsed)
 
                 vnc->waitTime ++;
 
+                // (state first, see svSetConnectState)
+                int nState = itm->connectState;
+                long nInStateMs = svMonotonicMs() - itm->connectStateMs;
+                int nStateTimeout = svConnectStateTimeout(nState);
+
+                // stuck in one setup step, even if it's a listener's
+                bool stateTimedOut = (nStateTimeout > 0 && nInStateMs > nStateTimeout * 1000L);
+
                 // 'soft' time-out reached
-                if (vnc->waitTime > app->nConnectionTimeout && itm->isListener == false)
+                if ((vnc->waitTime > app->nConnectionTimeout && itm->isListener == false)
+                    || stateTimedOut == true)
                 {
                     svDebugLog("svConnectionWatcher - 'Soft' timeout reached, giving up");
 
-                    VncObject::endAndDeleteViewer(&vnc);
+                    std::string strStage = svConnectStateName(nState);
+
+                    VncObject::endAndDeleteViewer(&itm->vnc);
 
                     app->nViewersWaiting --;
 
@@ -662,8 +990,8 @@ void svConnectionWatcher (void * notUsed)
                     itm->icon = app->iconNoConnect;
                     svHandleListItemIconChange(NULL);
 
-                    svLogToFile(std::string(std::string("Could not connect to '") +
-                      itm->name + "' - " + itm->hostAddress).c_str());
+                    svLogToFile("Could not connect to '" + itm->name + "' - " +
+                      itm->hostAddress + " (timed out " + strStage + ")");
                 }
             }
 
@@ -694,10 +1022,13 @@ void svConnectionWatcher (void * notUsed)
         if (vnc == NULL || itm->isConnected == false)
             continue;
 
+        // see if an 'r'esize host did as it was asked
+        vnc->checkRemoteResize();
+
         // check if connection has been inactive, unless this itm is ignoring
         if (vnc->inactiveSeconds >= app->nDeadTimeout && itm->ignoreInactive == false)
             // remote host hasn't responded in time allotted, disconnect
-            VncObject::endAndDeleteViewer(&vnc);
+            VncObject::endAndDeleteViewer(&itm->vnc);
         else
             vnc->inactiveSeconds ++;
     }
@@ -732,6 +1063,45 @@ bool svConvertStringToBoolean (const std::string& strIn)
 }
 
 
+/*
+ * tidy a space-separated list of vnc encoding names: lower-cased, no
+ * duplicates and only names libvnc knows.  Anything dropped goes in
+ * 'strDropped'.  (The LastRect, DesktopSize and cursor pseudo-encodings
+ * are always added by libvnc, so they aren't listed)
+ */
+std::string svCleanEncodingList (const std::string& strIn, std::string& strDropped)
+{
+    const std::string strKnown = std::string(" ") + SV_KNOWN_ENCODINGS + " ";
+    std::string strOut;
+    std::string strName;
+
+    strDropped = "";
+
+    for (size_t i = 0; i <= strIn.size(); i ++)
+    {
+        char c = (i < strIn.size() ? strIn[i] : ' ');
+
+        if (c != ' ' && c != ',' && c != '\t')
+        {
+            strName += static_cast<char>(tolower(c));
+            continue;
+        }
+
+        if (strName == "")
+            continue;
+
+        if (strKnown.find(" " + strName + " ") == std::string::npos)
+            strDropped += (strDropped == "" ? "" : " ") + strName;
+        else if ((" " + strOut + " ").find(" " + strName + " ") == std::string::npos)
+            strOut += (strOut == "" ? "" : " ") + strName;
+
+        strName = "";
+    }
+
+    return strOut;
+}
+
+
 /* create icons for app */
 void svCreateAppIcons (bool fromAppOptions)
 {
@@ -905,6 +1275,23 @@ void svDeleteItem (int nItem)
 
     if (okayToDelete == true)
     {
+        // (don't let 'connect all' start or count it)
+        for (size_t i = 0; i < app->connectQueue.size(); i ++)
+            if (app->connectQueue[i] == itm)
+            {
+                app->connectQueue.erase(app->connectQueue.begin() + i);
+                app->nConnectQueueTotal --;
+                break;
+            }
+
+        for (size_t i = 0; i < app->connectQueueStarted.size(); i ++)
+            if (app->connectQueueStarted[i] == itm)
+            {
+                app->connectQueueStarted.erase(app->connectQueueStarted.begin() + i);
+                app->nConnectQueueTotal --;
+                break;
+            }
+
         app->hostList->remove(nItem);
         app->hostList->redraw();
     }
@@ -924,41 +1311,6 @@ void svDeselectAllItems ()
 }
 
 
-/* find unused TCP port in a range */
-int svFindFreeTcpPort ()
-{
-    int nSock = 0;
-    struct sockaddr_in structSockAddress;
-
-    structSockAddress.sin_family = AF_INET;
-    structSockAddress.sin_addr.s_addr = htonl(INADDR_ANY);
-
-    nSock = socket(AF_INET, SOCK_STREAM, 0);
-
-    if (nSock < 0)
-    {
-        svLogToFile("ERROR - Cannot create socket for svFindFreeTCPPort");
-        return 0;
-    }
-
-    for (int nPort = app->nStartingLocalPort + 99; nPort > app->nStartingLocalPort; nPort --)
-    {
-        structSockAddress.sin_port = htons((unsigned short)nPort);
-
-        if (bind(nSock, reinterpret_cast<sockaddr *>(&structSockAddress),
-            sizeof(structSockAddress)) == 0)
-        {
-            close(nSock);
-            return nPort;
-        }
-    }
-
-    close(nSock);
-
-    return 0;
-}
-
-
 /* return config property from input */
 std::string svGetConfigProperty (char * strIn)
 {
@@ -1063,12 +1415,24 @@ void svHandleAppOptionsButtons (Fl_Widget * widget, void * data)
                 if (strName == "spinScanTimeout")
                     app->nScanTimeout = static_cast<Fl_Spinner *>(wid)->value();
 
-                if (strName == "spinLocalSSHPort")
-                    app->nStartingLocalPort = static_cast<Fl_Spinner *>(wid)->value();
-
                 if (strName == "spinDeadTimeout")
                     app->nDeadTimeout = static_cast<Fl_Spinner *>(wid)->value();
 
+                if (strName == "spinBackgroundInterval")
+                    app->nBackgroundInterval = static_cast<Fl_Spinner *>(wid)->value();
+
+                if (strName == "spinMaxFps")
+                    app->nMaxFps = static_cast<Fl_Spinner *>(wid)->value();
+
+                if (strName == "spinMaxConnecting")
+                    app->nMaxConnecting = static_cast<Fl_Spinner *>(wid)->value();
+
+                if (strName == "spinConnectJitter")
+                    app->nConnectJitter = static_cast<Fl_Spinner *>(wid)->value();
+
+                if (strName == "spinProbeInterval")
+                    app->nProbeInterval = static_cast<Fl_Spinner *>(wid)->value();
+
                 if (strName == "inAppFontSize")
                     app->nAppFontSize = atoi(static_cast<SVInput *>(wid)->value());
 
@@ -1106,6 +1470,22 @@ void svHandleAppOptionsButtons (Fl_Widget * widget, void * data)
                         app->showReverseConnect = false;
                 }
 
+                if (strName == "chkUseXShm")
+                {
+                    if (static_cast<Fl_Check_Button *>(wid)->value() == 1)
+                        app->useXShm = true;
+                    else
+                        app->useXShm = false;
+                }
+
+                if (strName == "chkBackgroundSaver")
+                {
+                    if (static_cast<Fl_Check_Button *>(wid)->value() == 1)
+                        app->backgroundSaver = true;
+                    else
+                        app->backgroundSaver = false;
+                }
+
                 if (strName == "chkDebugMode")
                 {
                     if (static_cast<Fl_Check_Button *>(wid)->value() == 1)
@@ -1154,45 +1534,64 @@ void svHandleF8Buttons (Fl_Widget * widget, void * data)
         // ctrl+alt+delete button clicked
         if (strcmp(strName, SV_F8_BTN_CAD) == 0)
         {
-            SendKeyEvent(vnc->vncClient, XK_Control_L, true);
-            SendKeyEvent(vnc->vncClient, XK_Alt_L, true);
-            SendKeyEvent(vnc->vncClient, XK_Delete, true);
+            std::vector<VncKeyEvent> keys;
+
+            keys.push_back(VncKeyEvent(XK_Control_L, true));
+            keys.push_back(VncKeyEvent(XK_Alt_L, true));
+            keys.push_back(VncKeyEvent(XK_Delete, true));
+
+            keys.push_back(VncKeyEvent(XK_Control_L, false));
+            keys.push_back(VncKeyEvent(XK_Alt_L, false));
+            keys.push_back(VncKeyEvent(XK_Delete, false));
 
-            SendKeyEvent(vnc->vncClient, XK_Control_L, false);
-            SendKeyEvent(vnc->vncClient, XK_Alt_L, false);
-            SendKeyEvent(vnc->vncClient, XK_Delete, false);
+            vnc->sendKeyBatch(keys);
         }
 
         // ctrl+shift+esc button clicked
         if (strcmp(strName, SV_F8_BTN_CSE) == 0)
         {
-            SendKeyEvent(vnc->vncClient, XK_Control_L, true);
-            SendKeyEvent(vnc->vncClient, XK_Shift_L, true);
-            SendKeyEvent(vnc->vncClient, XK_Escape, true);
+            std::vector<VncKeyEvent> keys;
 
-            SendKeyEvent(vnc->vncClient, XK_Control_L, false);
-            SendKeyEvent(vnc->vncClient, XK_Shift_L, false);
-            SendKeyEvent(vnc->vncClient, XK_Escape, false);
+            keys.push_back(VncKeyEvent(XK_Control_L, true));
+            keys.push_back(VncKeyEvent(XK_Shift_L, true));
+            keys.push_back(VncKeyEvent(XK_Escape, true));
+
+            keys.push_back(VncKeyEvent(XK_Control_L, false));
+            keys.push_back(VncKeyEvent(XK_Shift_L, false));
+            keys.push_back(VncKeyEvent(XK_Escape, false));
+
+            vnc->sendKeyBatch(keys);
         }
 
         // ask server for a screen refresh
         if (strcmp(strName, SV_F8_BTN_REFRESH) == 0)
-            SendFramebufferUpdateRequest(vnc->vncClient, 0, 0,
-                vnc->vncClient->width, vnc->vncClient->height, false);
+            vnc->sendUpdateRequest(false);
 
         // send F8 key
         if (strcmp(strName, SV_F8_BTN_SEND_F8) == 0)
         {
-            SendKeyEvent(vnc->vncClient, XK_F8, true);
-            SendKeyEvent(vnc->vncClient, XK_F8, false);
+            std::vector<VncKeyEvent> keys;
+
+            keys.push_back(VncKeyEvent(XK_F8, true));
+            keys.push_back(VncKeyEvent(XK_F8, false));
+
+            vnc->sendKeyBatch(keys);
         }
 
         // send F12 key
         if (strcmp(strName, SV_F8_BTN_SEND_F12) == 0)
         {
-            SendKeyEvent(vnc->vncClient, XK_F12, true);
-            SendKeyEvent(vnc->vncClient, XK_F12, false);
+            std::vector<VncKeyEvent> keys;
+
+            keys.push_back(VncKeyEvent(XK_F12, true));
+            keys.push_back(VncKeyEvent(XK_F12, false));
+
+            vnc->sendKeyBatch(keys);
         }
+
+        // time a full refresh with each encoding and keep the fastest
+        if (strcmp(strName, SV_F8_BTN_BENCHMARK) == 0)
+            vnc->queueSend(VncSendItem('b'));
     }
 
     Fl::redraw();
@@ -1406,7 +1805,7 @@ void svHandleHostListEvents (Fl_Widget * list, void * data2)
         {
             itm->hasDisconnectRequest = true;
 
-            VncObject::endAndDeleteViewer(&vnc);
+            VncObject::endAndDeleteViewer(&itm->vnc);
 
             return;
         }
@@ -1434,13 +1833,35 @@ void svHandleHostListEvents (Fl_Widget * list, void * data2)
             else
                 nF12Flags = 0;
 
+            // include the last reachability check in menu
+            int nProbeFlags = FL_MENU_INVISIBLE;
+            char strProbe[64] = {0};
+
+            if (itm->probeState == SV_PROBE_UP)
+                snprintf(strProbe, sizeof(strProbe), "Reachable (%li ms)", itm->probeRttMs);
+            else if (itm->probeState == SV_PROBE_DOWN)
+                snprintf(strProbe, sizeof(strProbe), "Not reachable");
+
+            if (itm->probeState != SV_PROBE_UNKNOWN)
+                nProbeFlags = FL_MENU_INACTIVE | FL_MENU_DIVIDER;
+
+            // enable / disable 'Connect group' item in menu
+            int nGroupFlags = (itm->group == "" ? FL_MENU_INACTIVE : 0);
+
+            // show 'Stop connecting' while 'connect all' has hosts left to start
+            int nStopFlags = (app->connectQueue.empty() == true ? FL_MENU_INVISIBLE : 0);
+
             // create context menu
             const Fl_Menu_Item miMain[] = {
-                {strError,         0, 0, 0, nFlags,    0, 31, app->nMenuFontSize},
-                {"Connect",        0, 0, 0, 0,         0, 31, app->nMenuFontSize},
-                {"Edit",           0, 0, 0, 0,         0, 31, app->nMenuFontSize},
-                {"Copy F12 macro", 0, 0, 0, nF12Flags, 0, 31, app->nMenuFontSize},
-                {"Delete...",      0, 0, 0, 0,         0, 31, app->nMenuFontSize},
+                {strError,          0, 0, 0, nFlags,      0, 31, app->nMenuFontSize},
+                {strProbe,          0, 0, 0, nProbeFlags, 0, 31, app->nMenuFontSize},
+                {"Connect",         0, 0, 0, 0,           0, 31, app->nMenuFontSize},
+                {"Connect group",   0, 0, 0, nGroupFlags, 0, 31, app->nMenuFontSize},
+                {"Connect all",     0, 0, 0, 0,           0, 31, app->nMenuFontSize},
+                {"Stop connecting", 0, 0, 0, nStopFlags,  0, 31, app->nMenuFontSize},
+                {"Edit",            0, 0, 0, 0,           0, 31, app->nMenuFontSize},
+                {"Copy F12 macro",  0, 0, 0, nF12Flags,   0, 31, app->nMenuFontSize},
+                {"Delete...",       0, 0, 0, 0,           0, 31, app->nMenuFontSize},
                 {0}
             };
 
@@ -1460,6 +1881,16 @@ void svHandleHostListEvents (Fl_Widget * list, void * data2)
                     if (strcmp(strRes, "Connect") == 0)
                         VncObject::createVNCObject(itm);
 
+                    // connect this itm's group, or everything, a few at a time
+                    if (strcmp(strRes, "Connect group") == 0)
+                        svConnectQueueAdd(itm);
+
+                    if (strcmp(strRes, "Connect all") == 0)
+                        svConnectQueueAdd(NULL);
+
+                    if (strcmp(strRes, "Stop connecting") == 0)
+                        svConnectQueueStop();
+
                     // edit itm
                     if (strcmp(strRes, "Edit") == 0)
                         svShowItemOptions(itm);
@@ -1546,7 +1977,7 @@ void svHandleHostListEvents (Fl_Widget * list, void * data2)
                         {
                             int iIndx = svItemNumFromItm(itm);
 
-                            VncObject::endAndDeleteViewer(&vnc);
+                            VncObject::endAndDeleteViewer(&itm->vnc);
                             svDeleteItem(iIndx);
 
                             menuUp = false;
@@ -1671,6 +2102,13 @@ void svHandleItmOptionsButtons (Fl_Widget * widget, void * data)
                 if (strName == SV_ITM_F12_MACRO)
                     itm->f12Macro = static_cast<SVInput *>(wid)->value();
 
+                if (strName == SV_ITM_F12_DELAY)
+                {
+                    itm->f12MacroDelay = atoi(static_cast<SVInput *>(wid)->value());
+                    if (itm->f12MacroDelay < 0)
+                        itm->f12MacroDelay = 0;
+                }
+
                 if (strName == SV_ITM_CON_VNC)
                     if (static_cast<Fl_Radio_Round_Button *>(wid)->value() == 1)
                         itm->hostType = 'v';
@@ -1705,6 +2143,26 @@ void svHandleItmOptionsButtons (Fl_Widget * widget, void * data)
                         itm->qualityLevel = 9;
                 }
 
+                if (strName == SV_ITM_VNC_ENCODINGS)
+                {
+                    std::string strDropped;
+
+                    itm->encodings = svCleanEncodingList(static_cast<SVInput *>(wid)->value(),
+                        strDropped);
+
+                    if (strDropped != "")
+                        svMessageWindow("These aren't encodings SpiritVNC knows and were"
+                            " removed: " + strDropped);
+
+                    // hand a connected viewer's decoder its copy of the new list
+                    if (itm->vnc != NULL && itm->isConnected == true)
+                    {
+                        VncSendItem item('e', (itm->vnc->lowCostProfile == true ? 1 : 0));
+                        item.text = itm->encodings;
+                        itm->vnc->queueSend(item);
+                    }
+                }
+
                 if (strName == SV_ITM_IGN_DEAD)
                 {
                     if (static_cast<Fl_Check_Button *>(wid)->value() == 1)
@@ -1746,6 +2204,10 @@ void svHandleItmOptionsButtons (Fl_Widget * widget, void * data)
                             if (static_cast<Fl_Radio_Round_Button *>(chld)->value() == 1)
                                 itm->scaling = 'f';
 
+                        if (strChildName == SV_ITM_SCALE_RESIZE)
+                            if (static_cast<Fl_Radio_Round_Button *>(chld)->value() == 1)
+                                itm->scaling = 'r';
+
                         if (strChildName == SV_ITM_FAST_SCALE)
                         {
                             if (static_cast<Fl_Check_Button *>(chld)->value() == 1)
@@ -1764,6 +2226,22 @@ void svHandleItmOptionsButtons (Fl_Widget * widget, void * data)
                         itm->showRemoteCursor = false;
                 }
 
+                if (strName == SV_ITM_NATIVE_FORMAT)
+                {
+                    if (static_cast<Fl_Check_Button *>(wid)->value() == 1)
+                        itm->nativePixelFormat = true;
+                    else
+                        itm->nativePixelFormat = false;
+                }
+
+                if (strName == SV_ITM_ADAPTIVE)
+                {
+                    if (static_cast<Fl_Check_Button *>(wid)->value() == 1)
+                        itm->adaptiveQuality = true;
+                    else
+                        itm->adaptiveQuality = false;
+                }
+
                 if (strName == SV_ITM_SSH_NAME)
                     itm->sshUser = static_cast<SVInput *>(wid)->value();
 
@@ -1951,7 +2429,9 @@ void svHandleThreadConnection (void * data)
 
     VncObject * vnc = itm->vnc;
 
-    if (vnc == NULL)
+    // (a viewer that failed before its connection got going is already
+    // deleted, but its failure still needs showing)
+    if (vnc == NULL && itm->hasCouldntConnect == false)
         return;
 
     int nItem = svItemNumFromItm(itm);
@@ -1963,6 +2443,7 @@ void svHandleThreadConnection (void * data)
             " 'isWaitingToShow' to 'isConnected'");
 
         itm->isWaitingForShow = false;
+        svSetConnectState(itm, SV_CONN_CONNECTED);
 
         app->nViewersWaiting --;
 
@@ -1973,6 +2454,12 @@ void svHandleThreadConnection (void * data)
         svLogToFile("Connected to '" + itm->name + "' - " +
           itm->hostAddress);
 
+        // from here on, server messages are handled by its decoder thread
+        vnc->startDecoder();
+
+        // hosts start out hidden (showing the host below puts quality back)
+        vnc->setLowCostProfile(true);
+
         // show viewer if it matches the selected host list item
         int nSelectedHost = app->hostList->value();
 
@@ -2004,6 +2491,13 @@ void svHandleThreadConnection (void * data)
         itm->isConnected = false;
         app->nViewersWaiting --;
 
+        // free what the connection left behind (failures before the viewer
+        // got going have deleted it already)
+        if (itm->vnc != NULL && itm->hasEnded == false)
+            VncObject::endAndDeleteViewer(&itm->vnc);
+
+        svSetConnectState(itm, SV_CONN_FAILED);
+
         // set host list item status icon
         if (itm->lastErrorMessage != "")
           itm->icon = app->iconDisconnectedBigError;
@@ -2032,7 +2526,9 @@ void svHandleThreadConnection (void * data)
         {
             svDebugLog("svConnectionWatcher - 'Soft' timeout reached, giving up");
 
-            VncObject::endAndDeleteViewer(&vnc);
+            std::string strStage = svConnectStateName(itm->connectState);
+
+            VncObject::endAndDeleteViewer(&itm->vnc);
 
             app->nViewersWaiting --;
 
@@ -2040,15 +2536,41 @@ void svHandleThreadConnection (void * data)
             itm->icon = app->iconNoConnect;
             svHandleListItemIconChange(NULL);
 
-            // stop this thread because our 'soft' timeout was reached
-            svDebugLog("svConnectionWatcher - Canceling itm->threadRFB");
+            svLogToFile("Could not connect to '" + itm->name + "' - " + itm->hostAddress +
+                " (timed out " + strStage + ")");
+        }
+    }
+}
 
-            if (itm->threadRFB != 0)
-                pthread_cancel(itm->threadRFB);
 
-            svLogToFile("Could not connect to '" + itm->name + "' - " + itm->hostAddress);
-        }
+/*
+ * a host's ssh thread has finished setting up its tunnel, one way or the
+ * other, so start the vnc side or give up
+ * (called through Fl::awake)
+ */
+void svHandleSSHConnection (void * data)
+{
+    HostItem * itm = static_cast<HostItem *>(data);
+
+    // (a connection that's since timed out or been closed)
+    if (itm == NULL || itm->vnc == NULL || itm->isConnecting == false)
+        return;
+
+    if (itm->connectState == SV_CONN_SSH_READY)
+    {
+        VncObject::startRFBConnection(itm);
+        return;
     }
+
+    if (itm->connectState != SV_CONN_FAILED)
+        return;
+
+    svDebugLog("svHandleSSHConnection - SSH setup failed for '" + itm->name + "', giving up");
+
+    itm->isConnecting = false;
+    itm->hasCouldntConnect = true;
+
+    svHandleThreadConnection(itm);
 }
 
 
@@ -2299,6 +2821,29 @@ void svMessageWindow (const std::string& strMessage, const std::string& strTitle
 }
 
 
+/* milliseconds from a clock that never jumps, for measuring intervals */
+long svMonotonicMs ()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return static_cast<long>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+
+/* milliseconds of cpu time the calling thread has used */
+long svThreadCpuMs ()
+{
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0)
+        return 0;
+
+    return static_cast<long>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+
 /* return number of connected items (integer) */
 bool svThereAreConnectedItems ()
 {
@@ -2338,6 +2883,18 @@ void svResizeScroller ()
 }
 
 
+/* ask the host being viewed to match its desktop to the viewer (debounced) */
+void svRemoteResizeTimer (void * notUsed)
+{
+    (void) notUsed;
+
+    VncObject * vnc = app->vncViewer->vnc;
+
+    if (vnc != NULL)
+        vnc->requestRemoteResize();
+}
+
+
 /* restore previous session's window position */
 void svRestoreWindowSizePosition (void * notUsed)
 {
@@ -2401,11 +2958,11 @@ void svScanTimer (void * data)
 
             // 'tickle' host screen so it doesn't go to screensaver by
             // moving remote mouse back and forth a certain amount
-            SendPointerEvent(itm->vnc->vncClient, 0, 0, 0);
+            itm->vnc->sendPointerEvent(0, 0, 0);
             Fl::check();
-            SendPointerEvent(itm->vnc->vncClient, 100, 100, 0);
+            itm->vnc->sendPointerEvent(100, 100, 0);
             Fl::check();
-            SendPointerEvent(itm->vnc->vncClient, 0, 0, 0);
+            itm->vnc->sendPointerEvent(0, 0, 0);
             Fl::check();
             break;
         }
@@ -2416,23 +2973,44 @@ void svScanTimer (void * data)
 }
 
 
-/* send a stored text string to the vnc host */
-void svSendKeyStrokesToHost (std::string& strIn, VncObject * vnc)
+/* move a host's connection on to its next state */
+void svSetConnectState (HostItem * itm, int nState)
+{
+    if (itm == NULL)
+        return;
+
+    // (the time first, so whoever sees the new state sees when it started)
+    itm->connectStateMs = svMonotonicMs();
+    itm->connectState = nState;
+
+    svDebugLog("svSetConnectState - '" + itm->name + "' is now " + svConnectStateName(nState));
+}
+
+
+/*
+ * send a stored text string to the vnc host, all at once or with
+ * nDelayMs between key events
+ */
+void svSendKeyStrokesToHost (std::string& strIn, VncObject * vnc, int nDelayMs)
 {
     if (vnc == NULL)
         return;
 
-    for (int i = 0;; i ++)
+    std::vector<VncKeyEvent> keys;
+
+    for (size_t i = 0; i < strIn.size(); i ++)
     {
         if (strIn[i] == '\0')
-            return;
+            break;
 
         if (strIn[i] != '\n')
         {
-            SendKeyEvent(vnc->vncClient, strIn[i], true);
-            SendKeyEvent(vnc->vncClient, strIn[i], false);
+            keys.push_back(VncKeyEvent(strIn[i], true));
+            keys.push_back(VncKeyEvent(strIn[i], false));
         }
     }
+
+    vnc->sendKeyBatch(keys, nDelayMs);
 }
 
 
@@ -2586,7 +3164,7 @@ void svShowAppOptions ()
 
     // window size
     int nWinWidth = 650;
-    int nWinHeight = 500;
+    int nWinHeight = 655;
 
     // set window position
     int nX = (app->mainWin->w() / 2) - (nWinWidth / 2);
@@ -2630,20 +3208,6 @@ void svShowAppOptions ()
         spinScanTimeout->tooltip("When scanning, this is how long SpiritVNC waits before moving"
             " to the next connected host item");
 
-    // starting local ssh port number
-    Fl_Spinner * spinLocalSSHPort = new Fl_Spinner(nXPos, nYPos += nYStep,
-        100, 28, "Starting local SSH port number ");
-    spinLocalSSHPort->textsize(app->nAppFontSize);
-    spinLocalSSHPort->labelsize(app->nAppFontSize);
-    spinLocalSSHPort->step(1);
-    spinLocalSSHPort->minimum(1);
-    spinLocalSSHPort->maximum(200000);
-    spinLocalSSHPort->user_data(SV_OPTS_LOCAL_SSH_PORT);
-    spinLocalSSHPort->value(app->nStartingLocalPort);
-    if (app->showTooltips == true)
-        spinLocalSSHPort->tooltip("This is the first SSH port used locally for VNC-over-SSH"
-            " connections");
-
     // inactive connection timeout
     Fl_Spinner * spinDeadTimeout = new Fl_Spinner(nXPos, nYPos += nYStep,
         100, 28, "Inactive connection timeout (seconds) ");
@@ -2658,6 +3222,79 @@ void svShowAppOptions ()
         spinDeadTimeout->tooltip("This is the time, in seconds, SpiritVNC waits before"
             " disconnecting a remote host due to inactivity");
 
+    // background host service interval
+    Fl_Spinner * spinBackgroundInterval = new Fl_Spinner(nXPos, nYPos += nYStep,
+        100, 28, "Background host update interval (ms) ");
+    spinBackgroundInterval->textsize(app->nAppFontSize);
+    spinBackgroundInterval->labelsize(app->nAppFontSize);
+    spinBackgroundInterval->step(10);
+    spinBackgroundInterval->minimum(0);
+    spinBackgroundInterval->maximum(10000);
+    spinBackgroundInterval->user_data(SV_OPTS_BG_INTERVAL);
+    spinBackgroundInterval->value(app->nBackgroundInterval);
+    if (app->showTooltips == true)
+        spinBackgroundInterval->tooltip("Connected hosts that aren't being viewed are updated at"
+            " most this often, in milliseconds, which saves work and keeps them current."
+            "  Zero updates them as fast as the host sends");
+
+    // viewer frame rate cap
+    Fl_Spinner * spinMaxFps = new Fl_Spinner(nXPos, nYPos += nYStep,
+        100, 28, "Maximum viewer frame rate (fps) ");
+    spinMaxFps->textsize(app->nAppFontSize);
+    spinMaxFps->labelsize(app->nAppFontSize);
+    spinMaxFps->step(1);
+    spinMaxFps->minimum(0);
+    spinMaxFps->maximum(1000);
+    spinMaxFps->user_data(SV_OPTS_MAX_FPS);
+    spinMaxFps->value(app->nMaxFps);
+    if (app->showTooltips == true)
+        spinMaxFps->tooltip("The viewer shows the host's screen at most this many times a second,"
+            " merging anything in between.  Set it to your monitor's refresh rate.  Zero has"
+            " no limit");
+
+    // 'connect all' hosts set up at once
+    Fl_Spinner * spinMaxConnecting = new Fl_Spinner(nXPos, nYPos += nYStep,
+        100, 28, "Connect all - hosts set up at once ");
+    spinMaxConnecting->textsize(app->nAppFontSize);
+    spinMaxConnecting->labelsize(app->nAppFontSize);
+    spinMaxConnecting->step(1);
+    spinMaxConnecting->minimum(0);
+    spinMaxConnecting->maximum(1000);
+    spinMaxConnecting->user_data(SV_OPTS_MAX_CONNECTING);
+    spinMaxConnecting->value(app->nMaxConnecting);
+    if (app->showTooltips == true)
+        spinMaxConnecting->tooltip("'Connect group' and 'Connect all' wait until fewer than this"
+            " many hosts are still connecting before starting the next one.  Zero has no limit");
+
+    // 'connect all' random wait between hosts
+    Fl_Spinner * spinConnectJitter = new Fl_Spinner(nXPos, nYPos += nYStep,
+        100, 28, "Connect all - random wait per host (ms) ");
+    spinConnectJitter->textsize(app->nAppFontSize);
+    spinConnectJitter->labelsize(app->nAppFontSize);
+    spinConnectJitter->step(50);
+    spinConnectJitter->minimum(0);
+    spinConnectJitter->maximum(60000);
+    spinConnectJitter->user_data(SV_OPTS_CONNECT_JITTER);
+    spinConnectJitter->value(app->nConnectJitter);
+    if (app->showTooltips == true)
+        spinConnectJitter->tooltip("'Connect group' and 'Connect all' wait a random time, up to"
+            " this many milliseconds, before starting each host so servers aren't hit all at"
+            " once");
+
+    // host reachability check interval
+    Fl_Spinner * spinProbeInterval = new Fl_Spinner(nXPos, nYPos += nYStep,
+        100, 28, "Check hosts are reachable every (seconds) ");
+    spinProbeInterval->textsize(app->nAppFontSize);
+    spinProbeInterval->labelsize(app->nAppFontSize);
+    spinProbeInterval->step(10);
+    spinProbeInterval->minimum(0);
+    spinProbeInterval->maximum(86400);
+    spinProbeInterval->user_data(SV_OPTS_PROBE_INTERVAL);
+    spinProbeInterval->value(app->nProbeInterval);
+    if (app->showTooltips == true)
+        spinProbeInterval->tooltip("Hosts that aren't connected are checked in the background"
+            " this often, and their icons show whether they can be reached.  Zero turns the"
+            " checks off");
 
     Fl_Box * lblSep01 = new Fl_Box(nXPos, nYPos += nYStep + 14,
         100, 28, "Appearance Options");
@@ -2735,6 +3372,29 @@ void svShowAppOptions ()
         chkShowReverseConnect->tooltip("Check this to show a message window when a reverse"
         " connection happens.");
 
+    // use x11 shared memory for drawing viewers?
+    Fl_Check_Button * chkUseXShm = new Fl_Check_Button(nXPos, nYPos += nYStep,
+        210, 28, " Use shared memory drawing (X11)");
+    chkUseXShm->labelsize(app->nAppFontSize);
+    chkUseXShm->user_data(SV_OPTS_USE_XSHM);
+    if (app->useXShm == true)
+        chkUseXShm->set();
+    if (app->showTooltips == true)
+        chkUseXShm->tooltip("Check this to draw viewers straight from X11 shared memory when"
+        " the display is local.  Takes effect on the next connection");
+
+    // save bandwidth on hosts that aren't being viewed?
+    Fl_Check_Button * chkBackgroundSaver = new Fl_Check_Button(nXPos, nYPos += nYStep,
+        210, 28, " Save bandwidth on hosts not being viewed");
+    chkBackgroundSaver->labelsize(app->nAppFontSize);
+    chkBackgroundSaver->user_data(SV_OPTS_BG_SAVER);
+    if (app->backgroundSaver == true)
+        chkBackgroundSaver->set();
+    if (app->showTooltips == true)
+        chkBackgroundSaver->tooltip("Check this to have hosts that aren't being viewed send"
+        " low quality, highly compressed updates.  Full quality comes back when a host"
+        " is viewed");
+
     nYPos += nYStep;
 
     Fl_Box * boxFontLabel = new Fl_Box(nXPos, nYPos += nYStep, 210, 28,
@@ -2801,7 +3461,7 @@ void svShowF8Window ()
 
     // window size
     int nWinWidth = 230;
-    int nWinHeight = 300;
+    int nWinHeight = 410;
 
     // set window position
     int nX = (app->mainWin->w() / 2) - (nWinWidth / 2);
@@ -2865,6 +3525,46 @@ void svShowF8Window ()
     if (app->showTooltips == true)
         btnSendF12->tooltip("Click to press the F12 key on the current remote host");
 
+    Fl_Button * btnBenchmark = new Fl_Button(nXPos, nYPos += nYStep, 200, 35,
+        "Benchmark encodings");
+    btnBenchmark->box(FL_GTK_UP_BOX);
+    btnBenchmark->user_data(SV_F8_BTN_BENCHMARK);
+    btnBenchmark->callback(svHandleF8Buttons);
+    if (app->showTooltips == true)
+        btnBenchmark->tooltip("Click to time a full screen refresh from the current remote host"
+            " with each encoding and use the fastest from now on");
+
+    // how well the current host's messages are keeping up
+    VncObject * vnc = app->vncViewer->vnc;
+
+    if (vnc != NULL)
+    {
+        char strStats[192] = {};
+        char strTunnel[64] = {};
+        HostItem * itm = vnc->itm;
+
+        // ssh tunnel traffic, for hosts that use one
+        if (itm != NULL && itm->hostType == 's')
+            snprintf(strTunnel, sizeof(strTunnel), "\nSSH tunnel: %lu KB in, %lu KB out",
+                itm->sshBytesIn / 1024, itm->sshBytesOut / 1024);
+
+        snprintf(strStats, sizeof(strStats), "Unread: %i KB (most %i KB)\nLongest wait: %li ms\n"
+            "Frames: %li shown, %li merged, %li deferred%s",
+            vnc->queuedBytes / 1024, vnc->queuedBytesMax / 1024, vnc->serviceWaitMax,
+            vnc->framesPresented, std::max(vnc->framesDecoded - vnc->framesPresented, 0L),
+            vnc->framesDeferred, strTunnel);
+
+        Fl_Box * bxStats = new Fl_Box(nXPos, nYPos += nYStep, 200, 65);
+        bxStats->copy_label(strStats);
+        bxStats->labelsize(app->nAppFontSize);
+        bxStats->align(FL_ALIGN_CENTER | FL_ALIGN_INSIDE);
+        if (app->showTooltips == true)
+            bxStats->tooltip("Data from the current remote host that hadn't been handled yet, and"
+                " the longest any of it waited.  Frames shown, updates merged into them and"
+                " frames held back by the frame rate cap.  For SSH hosts, data carried through"
+                " the tunnel");
+    }
+
     // ############ bottom button ##########################################################
 
     // 'Close' button
@@ -2923,7 +3623,7 @@ void svShowItemOptions (HostItem * im)
 
     // window size
     int nWinWidth = 545;
-    int nWinHeight = 750;
+    int nWinHeight = 900;
 
     // set window position
     int nX = app->hostList->w() + 50;
@@ -2981,6 +3681,17 @@ void svShowItemOptions (HostItem * im)
         inF12Macro->tooltip("Key presses that are sent to the remote host when"
             " you press the F12 key");
 
+    // f12 macro key delay
+    SVInput * inF12MacroDelay = new SVInput(nXPos, nYPos += nYStep,
+        48, 28, "F12 macro key delay (ms) ");
+    char strF12Delay[15] = {0};
+    sprintf(strF12Delay, "%i", itm->f12MacroDelay);
+    inF12MacroDelay->value(strF12Delay);
+    inF12MacroDelay->user_data(SV_ITM_F12_DELAY);
+    if (app->showTooltips == true)
+        inF12MacroDelay->tooltip("Milliseconds between each key press and release of the F12"
+            " macro.  Zero sends the whole macro at once");
+
     // * vnc type buttons *
 
     // vnc without ssh
@@ -3040,6 +3751,15 @@ void svShowItemOptions (HostItem * im)
     if (app->showTooltips == true)
         inVNCQualityLevel->tooltip("The level of image quality, from 0 to 9");
 
+    // vnc encodings
+    SVInput * inVNCEncodings = new SVInput(nXPos, nYPos += nYStep, 210, 28, "Encodings ");
+    inVNCEncodings->value(itm->encodings.c_str());
+    inVNCEncodings->user_data(SV_ITM_VNC_ENCODINGS);
+    if (app->showTooltips == true)
+        inVNCEncodings->tooltip("Encodings to ask the host for, best first, separated by spaces"
+            " (" SV_KNOWN_ENCODINGS ").  Leave empty to have SpiritVNC choose."
+            "  'Benchmark encodings' in the F8 window fills this in");
+
     // ignore inactive connection checking
     Fl_Check_Button * chkIgnoreInactive = new Fl_Check_Button(nXPos, nYPos += nYStep,
         100, 28, " Don't auto-disconnect when inactive");
@@ -3081,6 +3801,15 @@ void svShowItemOptions (HostItem * im)
         rbScaleFit->tooltip("Choose this to scale down large host screens to fit the viewer but"
         " small host screens are not scaled up");
 
+    // resize the remote desktop
+    Fl_Radio_Round_Button * rbScaleResize = new Fl_Radio_Round_Button(nXPos, nYPos += nYStep,
+        100, 28, " Resize host to fit");
+    rbScaleResize->user_data(SV_ITM_SCALE_RESIZE);
+    rbScaleResize->callback(svItmOptionsRadioButtonsCallback);
+    if (app->showTooltips == true)
+        rbScaleResize->tooltip("Choose this to have the host change its screen size to match the"
+        " viewer, so nothing is scaled.  Hosts that can't are scaled up and down instead");
+
     // set pre-existing value
     if (itm->scaling == 's')
         rbScaleOff->set();
@@ -3088,6 +3817,8 @@ void svShowItemOptions (HostItem * im)
         rbScaleZoom->set();
     else if (itm->scaling == 'f')
         rbScaleFit->set();
+    else if (itm->scaling == 'r')
+        rbScaleResize->set();
 
     // fast scaling (instead of the default 'quality' scaling)
     Fl_Check_Button * chkScalingFast = new Fl_Check_Button(nXPos, nYPos += nYStep,
@@ -3112,6 +3843,30 @@ void svShowItemOptions (HostItem * im)
     if (itm->showRemoteCursor == true)
         chkShowRemoteCursor->set();
 
+    // have the server send pixels in the display's own format
+    Fl_Check_Button * chkNativePixelFormat = new Fl_Check_Button(nXPos, nYPos += nYStep,
+        100, 28, " Use display's native pixel format");
+    chkNativePixelFormat->user_data(SV_ITM_NATIVE_FORMAT);
+    if (app->showTooltips == true)
+        chkNativePixelFormat->tooltip("Check to have the host send pixels already in this"
+            " display's color layout, so they're drawn without conversion (X11 only)");
+
+    // set pre-existing value
+    if (itm->nativePixelFormat == true)
+        chkNativePixelFormat->set();
+
+    // let quality and compression follow the connection's speed
+    Fl_Check_Button * chkAdaptiveQuality = new Fl_Check_Button(nXPos, nYPos += nYStep,
+        100, 28, " Adapt quality to connection speed");
+    chkAdaptiveQuality->user_data(SV_ITM_ADAPTIVE);
+    if (app->showTooltips == true)
+        chkAdaptiveQuality->tooltip("Check to lower quality and raise compression (never past the"
+            " levels above) when updates are slow, and go back up when they're fast");
+
+    // set pre-existing value
+    if (itm->adaptiveQuality == true)
+        chkAdaptiveQuality->set();
+
     // * vnc over ssh options *
 
     // separate these values a little from above controls
@@ -3279,3 +4034,18 @@ void svUpdateHostListItemText ()
             app->hostList->text(i, strdup(itm->name.c_str()));
     }
 }
+
+
+/*
+ * the tcp port for a host's vnc port setting.  Like libvnc, numbers below
+ * 5900 are display numbers
+ */
+int svVncPortNumber (const std::string& strPort)
+{
+    int nPort = atoi(strPort.c_str());
+
+    if (nPort >= 0 && nPort < 5900)
+        nPort += 5900;
+
+    return nPort;
+}
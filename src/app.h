@@ -60,11 +60,17 @@
 #include <fstream>
 #include <arpa/inet.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
 #include <sys/socket.h>
 #include <pthread.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/select.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <libssh2.h>
 #include <stdlib.h>
 #include <signal.h>
@@ -73,8 +79,10 @@
 #include "consts_enums.h"
 #include "hostitem.h"
 #include "pixmaps.h"
+#include "scale.h"
 #include "vnc.h"
 #include "ssh.h"
+#include "probe.h"
 
 
 /* global app class */
@@ -118,7 +126,11 @@ public:
         nMainWinPreviousH(0),
         nScanTimeout(2),
         nDeadTimeout(100),
-        nStartingLocalPort(15000),
+        nBackgroundInterval(200),
+        nMaxFps(60),
+        nMaxConnecting(4),
+        nConnectJitter(250),
+        nProbeInterval(60),
         showTooltips(true),
         debugMode(false),
         nAppFontSize(10),
@@ -128,6 +140,8 @@ public:
         blockLocalClipboardHandling(false),
         packButtons(NULL),
         showReverseConnect(true),
+        useXShm(true),
+        backgroundSaver(true),
         savedX(0),
         savedY(0),
         savedW(800),
@@ -135,8 +149,24 @@ public:
         createdObjects(0),
         msgThread(0),
         strF12ClipVar(""),
-        windowIcon(NULL)
+        windowIcon(NULL),
+        sshPumpThread(0),
+        sshPumpRunning(false),
+        nConnectQueueTotal(0),
+        nConnectQueueConnected(0),
+        nConnectQueueFailed(0),
+        connectQueueNextMs(0),
+        probeThread(0),
+        probeRunning(false),
+        nProbesOutstanding(0)
     {
+        pthread_mutex_init(&sshTunnelsMutex, NULL);
+        pthread_cond_init(&sshSessionsCond, NULL);
+        pthread_mutex_init(&probeMutex, NULL);
+        pthread_cond_init(&probeCond, NULL);
+        sshPumpWakePipe[0] = -1;
+        sshPumpWakePipe[1] = -1;
+
         // get user's login name for reading/writing config file
 
         // linux / bsd
@@ -216,7 +246,11 @@ public:
     int nMainWinPreviousH;
     int nScanTimeout;
     int nDeadTimeout;
-    int nStartingLocalPort;
+    int nBackgroundInterval;
+    int nMaxFps;
+    int nMaxConnecting;
+    int nConnectJitter;
+    int nProbeInterval;
     bool showTooltips;
     bool debugMode;
     int nAppFontSize;
@@ -226,6 +260,8 @@ public:
     bool blockLocalClipboardHandling;
     Fl_Pack * packButtons;
     bool showReverseConnect;
+    bool useXShm;
+    bool backgroundSaver;
     int savedX;
     int savedY;
     int savedW;
@@ -234,6 +270,32 @@ public:
     pthread_t msgThread;
     std::string strF12ClipVar;
     Fl_Image * windowIcon;
+    // ssh tunnels, the sessions they share and the one thread that services them all
+    // (sshTunnelsMutex guards both lists)
+    std::vector<SshTunnel *> sshTunnels;
+    std::vector<SshSession *> sshSessions;
+    pthread_mutex_t sshTunnelsMutex;
+    pthread_cond_t sshSessionsCond;
+    pthread_t sshPumpThread;
+    bool sshPumpRunning;
+    int sshPumpWakePipe[2];
+    // 'connect all' scheduler - hosts still to start, hosts still setting up
+    // and how the batch has gone so far
+    std::vector<HostItem *> connectQueue;
+    std::vector<HostItem *> connectQueueStarted;
+    int nConnectQueueTotal;
+    int nConnectQueueConnected;
+    int nConnectQueueFailed;
+    long connectQueueNextMs;
+    // reachability prober - probes waiting for its thread, results waiting for
+    // the main thread (probeMutex guards both) and probes not back yet
+    std::vector<HostProbe> probeQueue;
+    std::vector<HostProbe> probeResults;
+    pthread_mutex_t probeMutex;
+    pthread_cond_t probeCond;
+    pthread_t probeThread;
+    bool probeRunning;
+    int nProbesOutstanding;
 } extern * app;
 
 
@@ -265,15 +327,21 @@ void svConfigCreateNew ();
 void svConfigReadCreateHostList ();
 void svConfigWrite ();
 void svConnectionWatcher (void *);
+void svConnectQueueAdd (HostItem *);
+void svConnectQueueShowProgress ();
+void svConnectQueueStop ();
+void svConnectQueueTimer (void *);
 void svCreateAppIcons (bool fromAppOptions = false);
 std::string svConvertBooleanToString (bool);
 bool svConvertStringToBoolean (const std::string&);
+std::string svCleanEncodingList (const std::string&, std::string&);
+std::string svConnectStateName (int);
+int svConnectStateTimeout (int);
 void svCreateGUI ();
 void * svCreateSSHConnection(void *);
 void svDebugLog (const std::string&);
 void svDeleteItem (int);
 void svDeselectAllItems ();
-int svFindFreeTcpPort ();
 std::string svGetConfigProperty (char *);
 std::string svGetConfigValue (char *);
 void svHandleAppOptionsButtons ();
@@ -284,6 +352,7 @@ void svHandleHostListEvents (Fl_Widget *, void *);
 void svHandleMainWindowEvents (Fl_Widget *, void *);
 void svPositionWidgets ();
 void svHandleListItemIconChange (void * notUsed);
+void svHandleSSHConnection (void *);
 void svHandleThreadConnection (void *);
 void svHandleThreadCursorChange (void * notUsed);
 void svInsertEmptyItem ();
@@ -297,16 +366,21 @@ void svListeningModeBegin ();
 void svListeningModeEnd ();
 void svLogToFile (const std::string&);
 void svMessageWindow (const std::string&, const std::string& = "SpiritVNC");
+long svMonotonicMs ();
 bool svThereAreConnectedItems ();
+long svThreadCpuMs ();
 void svResizeScroller ();
+void svRemoteResizeTimer (void *);
 void svRestoreWindowSizePosition (void *);
 void svScanTimer (void *);
-void svSendKeyStrokesToHost (std::string&, VncObject *);
+void svSendKeyStrokesToHost (std::string&, VncObject *, int = 0);
+void svSetConnectState (HostItem *, int);
 void svSetUnsetMainWindowTooltips ();
 void svShowAboutHelp ();
 void svShowAppOptions ();
 void svShowF8Window ();
 void svShowItemOptions (HostItem *);
 void svUpdateHostListItemText ();
+int svVncPortNumber (const std::string&);
 
 #endif
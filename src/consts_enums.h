@@ -45,6 +45,54 @@
 #define SV_PROP_LINE_MAX            4096
 #define SV_APP_FONT_SIZE            14
 #define SV_MAX_PROP_LEN             1024
+#define SV_MAX_DAMAGE_RECTS         32
+#define SV_SAVER_QUALITY_LEVEL      1
+#define SV_SAVER_COMPRESS_LEVEL     9
+#define SV_VIEWPORT_MARGIN          256
+#define SV_POINTER_COALESCE_MS      8
+#define SV_SSH_PUMP_TIMEOUT_MS      1000
+#define SV_SSH_LOOP_ERROR_LIMIT     100
+#define SV_SSH_CHANNEL_POLL_MS      50
+#define SV_SSH_SETUP_POLL_MS        100
+#define SV_SSH_CLOSE_TIMEOUT_MS     2000
+#define SV_CONNECT_QUEUE_TICK       0.05
+#define SV_LISTEN_POLL_USECS        250000
+#define SV_PROBE_BATCH              128
+#define SV_PROBE_TIMEOUT_MS         3000
+#define SV_PROBE_IDLE_CHECK         5.0
+#define SV_REMOTE_RESIZE_DELAY      0.5
+#define SV_REMOTE_RESIZE_TIMEOUT_MS 4000
+#define SV_ADAPT_TARGET_MS          100
+#define SV_ADAPT_INTERVAL_MS        2000
+#define SV_ADAPT_MIN_FRAMES         4
+#define SV_ENCODINGS                "tight copyrect hextile"
+#define SV_LAN_ENCODINGS            "copyrect hextile tight"
+#define SV_KNOWN_ENCODINGS          "tight zrle zywrle ultra hextile zlib corre rre raw copyrect"
+#define SV_BENCH_ENCODINGS          "tight zrle zywrle hextile ultra zlib raw"
+#define SV_BENCH_TIMEOUT_MS         20000
+
+// host connection states, in the order a connection goes through them
+enum {
+    SV_CONN_IDLE = 0,
+    SV_CONN_STARTING,
+    SV_CONN_SSH_CONNECT,
+    SV_CONN_SSH_HANDSHAKE,
+    SV_CONN_SSH_AUTH,
+    SV_CONN_SSH_CHANNEL,
+    SV_CONN_SSH_READY,
+    SV_CONN_VNC_CONNECT,
+    SV_CONN_LISTENING,
+    SV_CONN_RFB_INIT,
+    SV_CONN_CONNECTED,
+    SV_CONN_FAILED
+};
+
+// host reachability, as last probed
+enum {
+    SV_PROBE_UNKNOWN = 0,
+    SV_PROBE_UP,
+    SV_PROBE_DOWN
+};
 
 // return type for threads
 #define SV_RET_VOID         static_cast<void *>(NULL)
@@ -61,14 +109,20 @@
 
 // app options constants
 #define SV_OPTS_SCN_TIMEOUT     const_cast<char *>("spinScanTimeout")
-#define SV_OPTS_LOCAL_SSH_PORT  const_cast<char *>("spinLocalSSHPort")
 #define SV_OPTS_DEAD_TIMEOUT    const_cast<char *>("spinDeadTimeout")
+#define SV_OPTS_BG_INTERVAL     const_cast<char *>("spinBackgroundInterval")
+#define SV_OPTS_MAX_FPS         const_cast<char *>("spinMaxFps")
+#define SV_OPTS_MAX_CONNECTING  const_cast<char *>("spinMaxConnecting")
+#define SV_OPTS_CONNECT_JITTER  const_cast<char *>("spinConnectJitter")
+#define SV_OPTS_PROBE_INTERVAL  const_cast<char *>("spinProbeInterval")
 #define SV_OPTS_APP_FONT_SIZE   const_cast<char *>("inAppFontSize")
 #define SV_OPTS_LIST_FONT_NAME  const_cast<char *>("inListFont")
 #define SV_OPTS_LIST_FONT_SIZE  const_cast<char *>("inListFontSize")
 #define SV_OPTS_USE_CB_ICONS    const_cast<char *>("chkCBIcons")
 #define SV_OPTS_SHOW_TOOLTIPS   const_cast<char *>("chkShowTooltips")
 #define SV_OPTS_SHOW_REV_CON    const_cast<char *>("chkShowReverseConnect")
+#define SV_OPTS_USE_XSHM        const_cast<char *>("chkUseXShm")
+#define SV_OPTS_BG_SAVER        const_cast<char *>("chkBackgroundSaver")
 #define SV_OPTS_CANCEL          const_cast<char *>("btnCancel")
 #define SV_OPTS_SAVE            const_cast<char *>("btnSave")
 
@@ -77,19 +131,24 @@
 #define SV_ITM_GRP              const_cast<char *>("inGroup")
 #define SV_ITM_ADDRESS          const_cast<char *>("inAddress")
 #define SV_ITM_F12_MACRO        const_cast<char *>("inF12Macro")
+#define SV_ITM_F12_DELAY        const_cast<char *>("inF12MacroDelay")
 #define SV_ITM_CON_VNC          const_cast<char *>("rbVNC")
 #define SV_ITM_CON_SVNC         const_cast<char *>("rbSVNC")
 #define SV_ITM_VNC_PORT         const_cast<char *>("inVNCPort")
 #define SV_ITM_VNC_PASS         const_cast<char *>("inVNCPassword")
 #define SV_ITM_VNC_COMP         const_cast<char *>("inVNCCompressLevel")
 #define SV_ITM_VNC_QUAL         const_cast<char *>("inVNCQualityLevel")
+#define SV_ITM_VNC_ENCODINGS    const_cast<char *>("inVNCEncodings")
 #define SV_ITM_IGN_DEAD         const_cast<char *>("chkIgnoreInactive")
 #define SV_ITM_GRP_SCALE        const_cast<char *>("grpScaling")
 #define SV_ITM_SCALE_OFF        const_cast<char *>("rbScaleOff")
 #define SV_ITM_SCALE_ZOOM       const_cast<char *>("rbScaleZoom")
 #define SV_ITM_SCALE_FIT        const_cast<char *>("rbScaleFit")
+#define SV_ITM_SCALE_RESIZE     const_cast<char *>("rbScaleResize")
 #define SV_ITM_FAST_SCALE       const_cast<char *>("chkScalingFast")
 #define SV_ITM_SHW_REM_CURSOR   const_cast<char *>("chkShowRemoteCursor")
+#define SV_ITM_NATIVE_FORMAT    const_cast<char *>("chkNativePixelFormat")
+#define SV_ITM_ADAPTIVE         const_cast<char *>("chkAdaptiveQuality")
 #define SV_ITM_GRP_SSH          const_cast<char *>("bxSSHSection")
 #define SV_ITM_SSH_NAME         const_cast<char *>("inSSHName")
 #define SV_ITM_SSH_PASS         const_cast<char *>("inSSHPassword")
@@ -106,6 +165,7 @@
 #define SV_F8_BTN_REFRESH   const_cast<char *>("btnRefresh")
 #define SV_F8_BTN_SEND_F8   const_cast<char *>("btnSendF8")
 #define SV_F8_BTN_SEND_F12  const_cast<char *>("btnSendF12")
+#define SV_F8_BTN_BENCHMARK const_cast<char *>("btnBenchmark")
 #define SV_F8_BTN_CLOSE     const_cast<char *>("btnClose")
 
 #endif
@@ -36,6 +36,7 @@
 #define HOSTITEM_H
 
 #include <FL/Fl_Image.H>
+#include <atomic>
 #include <iostream>
 #include "vnc.h"
 #include "consts_enums.h"
@@ -56,26 +57,36 @@ public:
         sshPass(""),
         sshKeyPublic(""),
         sshKeyPrivate(""),
-        sshLocalPort(0),
+        sshForwardSock(-1),
         vncPassword(""),
         hostType('v'),
         vnc(NULL),
         threadRFB(0),
-        threadRFBRunning(false),
         threadSSH(0),
         threadLoop(0),
         sshReady(false),
-        stopSSH(false),
+        sshStopAttempt(0),
+        sshBytesIn(0),
+        sshBytesOut(0),
         vncAddressAndPort(""),
         f12Macro(""),
+        f12MacroDelay(0),
         scaling('f'),
         scalingFast(false),
         showRemoteCursor(false),
+        nativePixelFormat(true),
+        adaptiveQuality(true),
         compressLevel(5),
         qualityLevel(5),
+        encodings(""),
         ignoreInactive(false),
         centerX(false),
         centerY(false),
+        connectState(SV_CONN_IDLE),
+        connectStateMs(0),
+        connectAttempt(0),
+        probeState(SV_PROBE_UNKNOWN),
+        probeRttMs(-1),
         isListener(false),
         isConnecting(false),
         isConnected(false),
@@ -97,33 +108,46 @@ public:
     std::string sshPass;
     std::string sshKeyPublic;
     std::string sshKeyPrivate;
-    int sshLocalPort;
+    int sshForwardSock;
     std::string vncPassword;
     char hostType;
     VncObject * vnc;
     pthread_t threadRFB;
-    bool threadRFBRunning;
     pthread_t threadSSH;
     pthread_t threadLoop;
-    bool sshReady;
-    bool stopSSH;
+    // (shared with the ssh threads, which only act on them for their own
+    // connectAttempt: a stop request names the attempt to stop)
+    std::atomic<bool> sshReady;
+    std::atomic<int> sshStopAttempt;
+    unsigned long sshBytesIn;
+    unsigned long sshBytesOut;
     std::string vncAddressAndPort;
     std::string f12Macro;
+    int f12MacroDelay;
     char scaling;
     bool scalingFast;
     bool showRemoteCursor;
+    bool nativePixelFormat;
+    bool adaptiveQuality;
     int compressLevel;
     int qualityLevel;
+    std::string encodings;
     bool ignoreInactive;
     bool centerX;
     bool centerY;
     //
+    // (set by the connection threads too, see svSetConnectState)
+    std::atomic<int> connectState;
+    std::atomic<long> connectStateMs;
+    std::atomic<int> connectAttempt;
+    int probeState;
+    long probeRttMs;
     bool isListener;
     bool isConnecting;
     bool isConnected;
     bool isWaitingForShow;
     bool hasCouldntConnect;
-    bool hasError;
+    std::atomic<bool> hasError;
     bool hasDisconnectRequest;
     bool hasEnded;
     Fl_Image * icon;
@@ -0,0 +1,352 @@
+/*
+ * probe.cxx - part of SpiritVNC - FLTK
+ * 2016-2021 Will Brokenbourgh https://www.pismotek.com/brainout/
+ */
+
+/*
+ * (C) Will Brokenbourgh
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of
+ * conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of
+ * conditions and the following disclaimer in the documentation and/or other materials provided
+ * with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used
+ * to endorse or promote products derived from this software without specific prior written
+ * permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "app.h"
+#include "hostitem.h"
+#include "probe.h"
+
+#include <netdb.h>
+#include <pthread.h>
+#include <poll.h>
+#include <algorithm>
+
+
+/*
+ * check every idle host in the list is reachable, by tcp connecting to
+ * the port it would be connected through (main thread)
+ */
+void svProbeHostList ()
+{
+    std::vector<HostProbe> probes;
+
+    for (int i = 0; i <= app->hostList->size(); i ++)
+    {
+        HostItem * itm = static_cast<HostItem *>(app->hostList->data(i));
+
+        if (itm == NULL || itm->isListener == true || itm->hostAddress == "")
+            continue;
+
+        // (a connection says for itself whether the host is there)
+        if (itm->isConnected == true || itm->isConnecting == true)
+            continue;
+
+        HostProbe probe;
+
+        probe.itm = itm;
+        probe.address = itm->hostAddress;
+
+        // ssh hosts only show their ssh port to the outside
+        if (itm->hostType == 's')
+            probe.port = itm->sshPort;
+        else
+        {
+            char strPort[16] = {0};
+            snprintf(strPort, sizeof(strPort), "%i", svVncPortNumber(itm->vncPort));
+            probe.port = strPort;
+        }
+
+        probes.push_back(probe);
+    }
+
+    if (probes.empty() == true)
+        return;
+
+    bool threadFailed = false;
+
+    pthread_mutex_lock(&app->probeMutex);
+
+    app->probeQueue.insert(app->probeQueue.end(), probes.begin(), probes.end());
+
+    if (app->probeRunning == false)
+    {
+        if (pthread_create(&app->probeThread, NULL, svProbeThread, NULL) == 0)
+            app->probeRunning = true;
+        else
+        {
+            app->probeQueue.clear();
+            threadFailed = true;
+        }
+    }
+
+    pthread_cond_signal(&app->probeCond);
+    pthread_mutex_unlock(&app->probeMutex);
+
+    if (threadFailed == true)
+    {
+        svDebugLog("svProbeHostList - ERROR - Could not start the probe thread");
+        return;
+    }
+
+    app->nProbesOutstanding += probes.size();
+}
+
+
+/*
+ * probe the host list every app->nProbeInterval seconds, unless the last
+ * round is still going
+ * (timer callback)
+ */
+void svProbeTimer (void * notUsed)
+{
+    (void) notUsed;
+
+    if (app->nProbeInterval > 0 && app->nProbesOutstanding == 0)
+        svProbeHostList();
+
+    // (checks back now and then in case probing gets turned on)
+    Fl::repeat_timeout((app->nProbeInterval > 0 ? app->nProbeInterval : SV_PROBE_IDLE_CHECK),
+        svProbeTimer);
+}
+
+
+/*
+ * the one thread that probes hosts.  It takes queued probes a batch at a
+ * time, starts all of a batch's connects at once and waits for them
+ * together in poll(), so a big host list doesn't need a thread per host
+ * (this is called as a thread and runs until the app exits)
+ */
+void * svProbeThread (void * notUsed)
+{
+    pthread_detach(pthread_self());
+
+    std::vector<HostProbe> batch;
+
+    while (true)
+    {
+        pthread_mutex_lock(&app->probeMutex);
+
+        while (app->probeQueue.empty() == true)
+            pthread_cond_wait(&app->probeCond, &app->probeMutex);
+
+        size_t nCount = std::min(app->probeQueue.size(), static_cast<size_t>(SV_PROBE_BATCH));
+
+        batch.assign(app->probeQueue.begin(), app->probeQueue.begin() + nCount);
+        app->probeQueue.erase(app->probeQueue.begin(), app->probeQueue.begin() + nCount);
+
+        pthread_mutex_unlock(&app->probeMutex);
+
+        svProbeBatch(batch);
+
+        pthread_mutex_lock(&app->probeMutex);
+        app->probeResults.insert(app->probeResults.end(), batch.begin(), batch.end());
+        pthread_mutex_unlock(&app->probeMutex);
+
+        Fl::awake(svProbeHandleResults, NULL);
+    }
+
+    return SV_RET_VOID;
+}
+
+
+/* run one batch of probes, giving each SV_PROBE_TIMEOUT_MS to connect */
+void svProbeBatch (std::vector<HostProbe>& batch)
+{
+    std::vector<struct pollfd> pfds;
+    std::vector<size_t> pending;
+
+    for (size_t i = 0; i < batch.size(); i ++)
+    {
+        svProbeStart(batch[i]);
+
+        if (batch[i].state == SV_PROBE_UNKNOWN)
+            pending.push_back(i);
+    }
+
+    long nDeadline = svMonotonicMs() + SV_PROBE_TIMEOUT_MS;
+
+    while (pending.empty() == false)
+    {
+        long nWait = nDeadline - svMonotonicMs();
+
+        if (nWait <= 0)
+            break;
+
+        pfds.resize(pending.size());
+
+        for (size_t i = 0; i < pending.size(); i ++)
+        {
+            pfds[i].fd = batch[pending[i]].sock;
+            pfds[i].events = POLLOUT;
+            pfds[i].revents = 0;
+        }
+
+        int rc = poll(&pfds[0], pfds.size(), static_cast<int>(nWait));
+
+        if (rc == -1 && errno != EINTR)
+        {
+            svDebugLog("svProbeBatch - ERROR - poll() error on sockets");
+            break;
+        }
+
+        if (rc <= 0)
+            continue;
+
+        long nNow = svMonotonicMs();
+
+        // (backwards, so finished probes can come out of the list as we go)
+        for (size_t i = pending.size(); i > 0; i --)
+        {
+            if (pfds[i - 1].revents == 0)
+                continue;
+
+            HostProbe& probe = batch[pending[i - 1]];
+
+            int nError = 0;
+            socklen_t nLen = sizeof(nError);
+
+            if (getsockopt(probe.sock, SOL_SOCKET, SO_ERROR, &nError, &nLen) == 0 && nError == 0)
+            {
+                probe.state = SV_PROBE_UP;
+                probe.rttMs = nNow - probe.startMs;
+            }
+            else
+                probe.state = SV_PROBE_DOWN;
+
+            close(probe.sock);
+            probe.sock = -1;
+
+            pending.erase(pending.begin() + (i - 1));
+        }
+    }
+
+    // whatever hasn't answered by now is down
+    for (size_t i = 0; i < pending.size(); i ++)
+    {
+        HostProbe& probe = batch[pending[i]];
+
+        probe.state = SV_PROBE_DOWN;
+        close(probe.sock);
+        probe.sock = -1;
+    }
+}
+
+
+/*
+ * start a probe's connect without waiting for it.  If it can't even be
+ * started, the probe is marked down
+ */
+void svProbeStart (HostProbe& probe)
+{
+    struct addrinfo hints;
+    struct addrinfo * addrs = NULL;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_NUMERICSERV;
+
+    probe.state = SV_PROBE_DOWN;
+
+    // (only the first address is tried, which is the one a connection would use first)
+    if (getaddrinfo(probe.address.c_str(), probe.port.c_str(), &hints, &addrs) != 0
+        || addrs == NULL)
+        return;
+
+    probe.sock = socket(addrs->ai_family, addrs->ai_socktype, addrs->ai_protocol);
+
+    if (probe.sock >= 0)
+    {
+        fcntl(probe.sock, F_SETFL, fcntl(probe.sock, F_GETFL, 0) | O_NONBLOCK);
+
+        probe.startMs = svMonotonicMs();
+
+        int rc = connect(probe.sock, addrs->ai_addr, addrs->ai_addrlen);
+
+        if (rc == 0)
+        {
+            probe.state = SV_PROBE_UP;
+            probe.rttMs = 0;
+        }
+        else if (errno == EINPROGRESS)
+            probe.state = SV_PROBE_UNKNOWN;
+
+        // (still going probes keep their socket for svProbeBatch)
+        if (probe.state != SV_PROBE_UNKNOWN)
+        {
+            close(probe.sock);
+            probe.sock = -1;
+        }
+    }
+
+    freeaddrinfo(addrs);
+}
+
+
+/*
+ * show what the probe thread found out on the host list icons
+ * (called through Fl::awake)
+ */
+void svProbeHandleResults (void * notUsed)
+{
+    (void) notUsed;
+
+    std::vector<HostProbe> results;
+
+    pthread_mutex_lock(&app->probeMutex);
+    results.swap(app->probeResults);
+    pthread_mutex_unlock(&app->probeMutex);
+
+    int nUp = 0;
+
+    for (size_t i = 0; i < results.size(); i ++)
+    {
+        HostItem * itm = results[i].itm;
+
+        itm->probeState = results[i].state;
+        itm->probeRttMs = results[i].rttMs;
+
+        if (results[i].state == SV_PROBE_UP)
+            nUp ++;
+
+        // a host that's been connected since, or shows a connection error, keeps its icon
+        if (itm->isConnected == true || itm->isConnecting == true
+            || (itm->icon != app->iconDisconnected && itm->icon != app->iconNoConnect
+            && itm->icon != NULL))
+            continue;
+
+        itm->icon = (results[i].state == SV_PROBE_UP ? app->iconDisconnected : app->iconNoConnect);
+    }
+
+    app->nProbesOutstanding -= results.size();
+
+    if (app->nProbesOutstanding < 0)
+        app->nProbesOutstanding = 0;
+
+    char strMsg[80] = {0};
+    snprintf(strMsg, sizeof(strMsg), "svProbeHandleResults - %i of %i hosts reachable",
+        nUp, static_cast<int>(results.size()));
+    svDebugLog(strMsg);
+
+    svHandleListItemIconChange(NULL);
+}
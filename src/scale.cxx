@@ -0,0 +1,733 @@
+/*
+ * scale.cxx - part of SpiritVNC - FLTK
+ * 2016-2021 Will Brokenbourgh https://www.pismotek.com/brainout/
+ */
+
+/*
+ * (C) Will Brokenbourgh
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of
+ * conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of
+ * conditions and the following disclaimer in the documentation and/or other materials provided
+ * with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used
+ * to endorse or promote products derived from this software without specific prior written
+ * permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "scale.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+// SSE2 / AVX2 kernels are built with per-function target attributes and
+// picked at runtime, so the binary still runs on cpus without them
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define SV_SCALE_X86
+#include <immintrin.h>
+#endif
+
+
+/* row kernels for one instruction set level */
+class SVScaleKernels
+{
+public:
+    void (*nearest4)(const uint32_t *, const int *, uint32_t *, int);
+    void (*nearest2)(const uint16_t *, const int *, uint16_t *, int);
+    void (*blendV4)(const unsigned char *, const unsigned char *, unsigned char *, int, int);
+    void (*blendV2)(const uint16_t *, const uint16_t *, uint16_t *, int, int,
+        const SVScaleFormat *);
+    void (*blendH4)(const uint32_t *, const int *, const int *, const int *, uint32_t *, int);
+    void (*blendH2)(const uint16_t *, const int *, const int *, const int *, uint16_t *, int,
+        const SVScaleFormat *);
+};
+
+
+/* source pixel sampled by destination pixel 'nDst' (nearest neighbour) */
+static inline int svNearestSource (int nDst, int nSrcSize, int nDstSize)
+{
+    return static_cast<int>((static_cast<int64_t>(nDst) * 2 + 1) * nSrcSize / (2 * nDstSize));
+}
+
+
+/*
+ * source position sampled by destination pixel 'nDst' (bilinear), as the left
+ * pixel, right pixel and right pixel's weight (0 - 255)
+ */
+static inline void svBilinearSource (int nDst, int nSrcSize, int nDstSize,
+    int& nS0, int& nS1, int& nWeight)
+{
+    int64_t nPos = (static_cast<int64_t>(nDst) * 2 + 1) * nSrcSize * 256 / (2 * nDstSize) - 128;
+
+    if (nPos < 0)
+        nPos = 0;
+
+    nS0 = static_cast<int>(nPos >> 8);
+    nWeight = static_cast<int>(nPos & 255);
+
+    if (nS0 >= nSrcSize - 1)
+    {
+        nS0 = nSrcSize - 1;
+        nWeight = 0;
+    }
+
+    nS1 = (nS0 < nSrcSize - 1) ? nS0 + 1 : nS0;
+}
+
+
+/*
+ * mix of 'a' and 'b' with 'b' weighted 'nW' (0 - 255).  The SIMD kernels do the
+ * same sum in 16-bit lanes, which can't overflow: 255 * 256 + 128 < 65536
+ */
+static inline int svLerp (int a, int b, int nW)
+{
+    return (a * (256 - nW) + b * nW + 128) >> 8;
+}
+
+
+/* blend two 2-byte pixels channel by channel */
+static inline uint16_t svLerp16 (uint16_t a, uint16_t b, int nW, const SVScaleFormat * fmt)
+{
+    const int nShifts[3] = {fmt->redShift, fmt->greenShift, fmt->blueShift};
+    const int nMaxes[3] = {fmt->redMax, fmt->greenMax, fmt->blueMax};
+    uint16_t nOut = 0;
+
+    for (int c = 0; c < 3; c ++)
+    {
+        int nV = svLerp((a >> nShifts[c]) & nMaxes[c], (b >> nShifts[c]) & nMaxes[c], nW);
+
+        nOut |= static_cast<uint16_t>(nV << nShifts[c]);
+    }
+
+    return nOut;
+}
+
+
+/* scalar kernels (the reference every other level has to match) */
+static void svNearest4Scalar (const uint32_t * pRow, const int * nXs, uint32_t * pOut, int n)
+{
+    for (int x = 0; x < n; x ++)
+        pOut[x] = pRow[nXs[x]];
+}
+
+
+static void svNearest2Scalar (const uint16_t * pRow, const int * nXs, uint16_t * pOut, int n)
+{
+    for (int x = 0; x < n; x ++)
+        pOut[x] = pRow[nXs[x]];
+}
+
+
+static void svBlendV4Scalar (const unsigned char * pRow0, const unsigned char * pRow1,
+    unsigned char * pOut, int nBytes, int nWY)
+{
+    for (int i = 0; i < nBytes; i ++)
+        pOut[i] = static_cast<unsigned char>(svLerp(pRow0[i], pRow1[i], nWY));
+}
+
+
+static void svBlendV2Scalar (const uint16_t * pRow0, const uint16_t * pRow1,
+    uint16_t * pOut, int n, int nWY, const SVScaleFormat * fmt)
+{
+    for (int i = 0; i < n; i ++)
+        pOut[i] = svLerp16(pRow0[i], pRow1[i], nWY, fmt);
+}
+
+
+static void svBlendH4Scalar (const uint32_t * pRow, const int * nX0s, const int * nX1s,
+    const int * nWXs, uint32_t * pOut, int n)
+{
+    for (int x = 0; x < n; x ++)
+    {
+        const unsigned char * p0 = reinterpret_cast<const unsigned char *>(pRow + nX0s[x]);
+        const unsigned char * p1 = reinterpret_cast<const unsigned char *>(pRow + nX1s[x]);
+        unsigned char * p = reinterpret_cast<unsigned char *>(pOut + x);
+
+        for (int c = 0; c < 4; c ++)
+            p[c] = static_cast<unsigned char>(svLerp(p0[c], p1[c], nWXs[x]));
+    }
+}
+
+
+static void svBlendH2Scalar (const uint16_t * pRow, const int * nX0s, const int * nX1s,
+    const int * nWXs, uint16_t * pOut, int n, const SVScaleFormat * fmt)
+{
+    for (int x = 0; x < n; x ++)
+        pOut[x] = svLerp16(pRow[nX0s[x]], pRow[nX1s[x]], nWXs[x], fmt);
+}
+
+
+static const SVScaleKernels svKernelsScalar = {
+    svNearest4Scalar, svNearest2Scalar,
+    svBlendV4Scalar, svBlendV2Scalar,
+    svBlendH4Scalar, svBlendH2Scalar
+};
+
+
+#ifdef SV_SCALE_X86
+
+#define SV_SSE2 __attribute__((target("sse2")))
+#define SV_AVX2 __attribute__((target("avx2")))
+
+/* (a * (256 - w) + b * w + 128) >> 8 on 16-bit lanes */
+static inline SV_SSE2 __m128i svLerpSSE2 (__m128i a, __m128i b, __m128i nW)
+{
+    const __m128i n256 = _mm_set1_epi16(256);
+    const __m128i nRound = _mm_set1_epi16(128);
+
+    __m128i nSum = _mm_add_epi16(_mm_mullo_epi16(a, _mm_sub_epi16(n256, nW)),
+        _mm_mullo_epi16(b, nW));
+
+    return _mm_srli_epi16(_mm_add_epi16(nSum, nRound), 8);
+}
+
+
+/* channel-by-channel blend of eight 2-byte pixels */
+static inline SV_SSE2 __m128i svLerp16SSE2 (__m128i a, __m128i b, __m128i nW,
+    const SVScaleFormat * fmt)
+{
+    const int nShifts[3] = {fmt->redShift, fmt->greenShift, fmt->blueShift};
+    const int nMaxes[3] = {fmt->redMax, fmt->greenMax, fmt->blueMax};
+    __m128i nOut = _mm_setzero_si128();
+
+    for (int c = 0; c < 3; c ++)
+    {
+        __m128i nShift = _mm_cvtsi32_si128(nShifts[c]);
+        __m128i nMask = _mm_set1_epi16(static_cast<short>(nMaxes[c]));
+        __m128i nA = _mm_and_si128(_mm_srl_epi16(a, nShift), nMask);
+        __m128i nB = _mm_and_si128(_mm_srl_epi16(b, nShift), nMask);
+
+        nOut = _mm_or_si128(nOut, _mm_sll_epi16(svLerpSSE2(nA, nB, nW), nShift));
+    }
+
+    return nOut;
+}
+
+
+/* sse2 kernels */
+static SV_SSE2 void svNearest4SSE2 (const uint32_t * pRow, const int * nXs, uint32_t * pOut,
+    int n)
+{
+    int x = 0;
+
+    for (; x + 4 <= n; x += 4)
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(pOut + x),
+            _mm_set_epi32(pRow[nXs[x + 3]], pRow[nXs[x + 2]], pRow[nXs[x + 1]], pRow[nXs[x]]));
+
+    svNearest4Scalar(pRow, nXs + x, pOut + x, n - x);
+}
+
+
+static SV_SSE2 void svNearest2SSE2 (const uint16_t * pRow, const int * nXs, uint16_t * pOut,
+    int n)
+{
+    int x = 0;
+
+    for (; x + 8 <= n; x += 8)
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(pOut + x),
+            _mm_set_epi16(pRow[nXs[x + 7]], pRow[nXs[x + 6]], pRow[nXs[x + 5]],
+                pRow[nXs[x + 4]], pRow[nXs[x + 3]], pRow[nXs[x + 2]], pRow[nXs[x + 1]],
+                pRow[nXs[x]]));
+
+    svNearest2Scalar(pRow, nXs + x, pOut + x, n - x);
+}
+
+
+static SV_SSE2 void svBlendV4SSE2 (const unsigned char * pRow0, const unsigned char * pRow1,
+    unsigned char * pOut, int nBytes, int nWY)
+{
+    const __m128i nZero = _mm_setzero_si128();
+    const __m128i nW = _mm_set1_epi16(static_cast<short>(nWY));
+    int i = 0;
+
+    for (; i + 16 <= nBytes; i += 16)
+    {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pRow0 + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pRow1 + i));
+
+        __m128i nLo = svLerpSSE2(_mm_unpacklo_epi8(a, nZero), _mm_unpacklo_epi8(b, nZero), nW);
+        __m128i nHi = svLerpSSE2(_mm_unpackhi_epi8(a, nZero), _mm_unpackhi_epi8(b, nZero), nW);
+
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(pOut + i), _mm_packus_epi16(nLo, nHi));
+    }
+
+    svBlendV4Scalar(pRow0 + i, pRow1 + i, pOut + i, nBytes - i, nWY);
+}
+
+
+static SV_SSE2 void svBlendV2SSE2 (const uint16_t * pRow0, const uint16_t * pRow1,
+    uint16_t * pOut, int n, int nWY, const SVScaleFormat * fmt)
+{
+    const __m128i nW = _mm_set1_epi16(static_cast<short>(nWY));
+    int i = 0;
+
+    for (; i + 8 <= n; i += 8)
+    {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pRow0 + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pRow1 + i));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(pOut + i), svLerp16SSE2(a, b, nW, fmt));
+    }
+
+    svBlendV2Scalar(pRow0 + i, pRow1 + i, pOut + i, n - i, nWY, fmt);
+}
+
+
+static SV_SSE2 void svBlendH4SSE2 (const uint32_t * pRow, const int * nX0s, const int * nX1s,
+    const int * nWXs, uint32_t * pOut, int n)
+{
+    const __m128i nZero = _mm_setzero_si128();
+    int x = 0;
+
+    for (; x + 4 <= n; x += 4)
+    {
+        __m128i a = _mm_set_epi32(pRow[nX0s[x + 3]], pRow[nX0s[x + 2]],
+            pRow[nX0s[x + 1]], pRow[nX0s[x]]);
+        __m128i b = _mm_set_epi32(pRow[nX1s[x + 3]], pRow[nX1s[x + 2]],
+            pRow[nX1s[x + 1]], pRow[nX1s[x]]);
+
+        // one weight per pixel, repeated across its four channels
+        __m128i nW = _mm_packs_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(nWXs + x)),
+            nZero);
+        nW = _mm_unpacklo_epi16(nW, nW);
+
+        __m128i nLo = svLerpSSE2(_mm_unpacklo_epi8(a, nZero), _mm_unpacklo_epi8(b, nZero),
+            _mm_unpacklo_epi32(nW, nW));
+        __m128i nHi = svLerpSSE2(_mm_unpackhi_epi8(a, nZero), _mm_unpackhi_epi8(b, nZero),
+            _mm_unpackhi_epi32(nW, nW));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(pOut + x), _mm_packus_epi16(nLo, nHi));
+    }
+
+    svBlendH4Scalar(pRow, nX0s + x, nX1s + x, nWXs + x, pOut + x, n - x);
+}
+
+
+static SV_SSE2 void svBlendH2SSE2 (const uint16_t * pRow, const int * nX0s, const int * nX1s,
+    const int * nWXs, uint16_t * pOut, int n, const SVScaleFormat * fmt)
+{
+    int x = 0;
+
+    for (; x + 8 <= n; x += 8)
+    {
+        __m128i a = _mm_set_epi16(pRow[nX0s[x + 7]], pRow[nX0s[x + 6]], pRow[nX0s[x + 5]],
+            pRow[nX0s[x + 4]], pRow[nX0s[x + 3]], pRow[nX0s[x + 2]], pRow[nX0s[x + 1]],
+            pRow[nX0s[x]]);
+        __m128i b = _mm_set_epi16(pRow[nX1s[x + 7]], pRow[nX1s[x + 6]], pRow[nX1s[x + 5]],
+            pRow[nX1s[x + 4]], pRow[nX1s[x + 3]], pRow[nX1s[x + 2]], pRow[nX1s[x + 1]],
+            pRow[nX1s[x]]);
+        __m128i nW = _mm_packs_epi32(
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(nWXs + x)),
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(nWXs + x + 4)));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(pOut + x), svLerp16SSE2(a, b, nW, fmt));
+    }
+
+    svBlendH2Scalar(pRow, nX0s + x, nX1s + x, nWXs + x, pOut + x, n - x, fmt);
+}
+
+
+static const SVScaleKernels svKernelsSSE2 = {
+    svNearest4SSE2, svNearest2SSE2,
+    svBlendV4SSE2, svBlendV2SSE2,
+    svBlendH4SSE2, svBlendH2SSE2
+};
+
+
+/* (a * (256 - w) + b * w + 128) >> 8 on 16-bit lanes */
+static inline SV_AVX2 __m256i svLerpAVX2 (__m256i a, __m256i b, __m256i nW)
+{
+    const __m256i n256 = _mm256_set1_epi16(256);
+    const __m256i nRound = _mm256_set1_epi16(128);
+
+    __m256i nSum = _mm256_add_epi16(_mm256_mullo_epi16(a, _mm256_sub_epi16(n256, nW)),
+        _mm256_mullo_epi16(b, nW));
+
+    return _mm256_srli_epi16(_mm256_add_epi16(nSum, nRound), 8);
+}
+
+
+/* four per-pixel weights spread over the 16 channel lanes of four 4-byte pixels */
+static inline SV_AVX2 __m256i svWeights4AVX2 (const int * nWXs)
+{
+    __m128i nW = _mm_loadu_si128(reinterpret_cast<const __m128i *>(nWXs));
+
+    nW = _mm_packs_epi32(nW, nW);
+    nW = _mm_unpacklo_epi16(nW, nW);
+
+    return _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_unpacklo_epi32(nW, nW)),
+        _mm_unpackhi_epi32(nW, nW), 1);
+}
+
+
+/* avx2 kernels */
+static SV_AVX2 void svNearest4AVX2 (const uint32_t * pRow, const int * nXs, uint32_t * pOut,
+    int n)
+{
+    int x = 0;
+
+    for (; x + 8 <= n; x += 8)
+    {
+        __m256i nIdx = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(nXs + x));
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(pOut + x),
+            _mm256_i32gather_epi32(reinterpret_cast<const int *>(pRow), nIdx, 4));
+    }
+
+    svNearest4Scalar(pRow, nXs + x, pOut + x, n - x);
+}
+
+
+static SV_AVX2 void svBlendV4AVX2 (const unsigned char * pRow0, const unsigned char * pRow1,
+    unsigned char * pOut, int nBytes, int nWY)
+{
+    const __m256i nZero = _mm256_setzero_si256();
+    const __m256i nW = _mm256_set1_epi16(static_cast<short>(nWY));
+    int i = 0;
+
+    // unpack and pack both work per 128-bit lane, so the byte order survives
+    for (; i + 32 <= nBytes; i += 32)
+    {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(pRow0 + i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(pRow1 + i));
+
+        __m256i nLo = svLerpAVX2(_mm256_unpacklo_epi8(a, nZero),
+            _mm256_unpacklo_epi8(b, nZero), nW);
+        __m256i nHi = svLerpAVX2(_mm256_unpackhi_epi8(a, nZero),
+            _mm256_unpackhi_epi8(b, nZero), nW);
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(pOut + i),
+            _mm256_packus_epi16(nLo, nHi));
+    }
+
+    svBlendV4SSE2(pRow0 + i, pRow1 + i, pOut + i, nBytes - i, nWY);
+}
+
+
+static SV_AVX2 void svBlendV2AVX2 (const uint16_t * pRow0, const uint16_t * pRow1,
+    uint16_t * pOut, int n, int nWY, const SVScaleFormat * fmt)
+{
+    const int nShifts[3] = {fmt->redShift, fmt->greenShift, fmt->blueShift};
+    const int nMaxes[3] = {fmt->redMax, fmt->greenMax, fmt->blueMax};
+    const __m256i nW = _mm256_set1_epi16(static_cast<short>(nWY));
+    int i = 0;
+
+    for (; i + 16 <= n; i += 16)
+    {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(pRow0 + i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(pRow1 + i));
+        __m256i nOut = _mm256_setzero_si256();
+
+        for (int c = 0; c < 3; c ++)
+        {
+            __m128i nShift = _mm_cvtsi32_si128(nShifts[c]);
+            __m256i nMask = _mm256_set1_epi16(static_cast<short>(nMaxes[c]));
+            __m256i nA = _mm256_and_si256(_mm256_srl_epi16(a, nShift), nMask);
+            __m256i nB = _mm256_and_si256(_mm256_srl_epi16(b, nShift), nMask);
+
+            nOut = _mm256_or_si256(nOut, _mm256_sll_epi16(svLerpAVX2(nA, nB, nW), nShift));
+        }
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(pOut + i), nOut);
+    }
+
+    svBlendV2SSE2(pRow0 + i, pRow1 + i, pOut + i, n - i, nWY, fmt);
+}
+
+
+static SV_AVX2 void svBlendH4AVX2 (const uint32_t * pRow, const int * nX0s, const int * nX1s,
+    const int * nWXs, uint32_t * pOut, int n)
+{
+    const int * pBase = reinterpret_cast<const int *>(pRow);
+    int x = 0;
+
+    for (; x + 8 <= n; x += 8)
+    {
+        __m256i a = _mm256_i32gather_epi32(pBase,
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(nX0s + x)), 4);
+        __m256i b = _mm256_i32gather_epi32(pBase,
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(nX1s + x)), 4);
+
+        __m256i nLo = svLerpAVX2(_mm256_cvtepu8_epi16(_mm256_castsi256_si128(a)),
+            _mm256_cvtepu8_epi16(_mm256_castsi256_si128(b)), svWeights4AVX2(nWXs + x));
+        __m256i nHi = svLerpAVX2(_mm256_cvtepu8_epi16(_mm256_extracti128_si256(a, 1)),
+            _mm256_cvtepu8_epi16(_mm256_extracti128_si256(b, 1)), svWeights4AVX2(nWXs + x + 4));
+
+        // packus interleaves the 128-bit lanes, so put the pixels back in order
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(pOut + x),
+            _mm256_permute4x64_epi64(_mm256_packus_epi16(nLo, nHi), 0xd8));
+    }
+
+    svBlendH4SSE2(pRow, nX0s + x, nX1s + x, nWXs + x, pOut + x, n - x);
+}
+
+
+static const SVScaleKernels svKernelsAVX2 = {
+    svNearest4AVX2, svNearest2SSE2,
+    svBlendV4AVX2, svBlendV2AVX2,
+    svBlendH4AVX2, svBlendH2SSE2
+};
+
+#endif
+
+
+static int nScaleLevel = -1;
+
+
+/* highest kernel level this cpu can run */
+static int svScaleBestLevel ()
+{
+    #ifdef SV_SCALE_X86
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2"))
+        return SV_SCALE_AVX2;
+
+    if (__builtin_cpu_supports("sse2"))
+        return SV_SCALE_SSE2;
+    #endif
+
+    return SV_SCALE_SCALAR;
+}
+
+
+/*
+ * choose the kernel level used for scaling (SV_SCALE_AUTO picks the best the
+ * cpu supports, higher requests are lowered to it), returning the level in use
+ */
+int svScaleSetLevel (int nLevel)
+{
+    int nBest = svScaleBestLevel();
+
+    if (nLevel == SV_SCALE_AUTO || nLevel > nBest)
+        nLevel = nBest;
+
+    if (nLevel < SV_SCALE_SCALAR)
+        nLevel = SV_SCALE_SCALAR;
+
+    nScaleLevel = nLevel;
+
+    return nScaleLevel;
+}
+
+
+/* kernel level currently used for scaling */
+int svScaleLevel ()
+{
+    if (nScaleLevel == -1)
+        svScaleSetLevel(SV_SCALE_AUTO);
+
+    return nScaleLevel;
+}
+
+
+/* name of a kernel level, for logging */
+const char * svScaleLevelName (int nLevel)
+{
+    switch (nLevel)
+    {
+        case SV_SCALE_SSE2:
+            return "sse2";
+        case SV_SCALE_AVX2:
+            return "avx2";
+        default:
+            return "scalar";
+    }
+}
+
+
+/* row kernels for the current level */
+static const SVScaleKernels * svScaleKernels ()
+{
+    #ifdef SV_SCALE_X86
+    switch (svScaleLevel())
+    {
+        case SV_SCALE_AVX2:
+            return &svKernelsAVX2;
+        case SV_SCALE_SSE2:
+            return &svKernelsSSE2;
+        default:
+            break;
+    }
+    #else
+    svScaleLevel();
+    #endif
+
+    return &svKernelsScalar;
+}
+
+
+/*
+ * render the rectangle dx, dy, dw, dh of 'src' scaled to dstW x dstH into 'dst'
+ * (both buffers are packed, 'bpp' bytes per pixel).  Any rectangle comes out
+ * exactly as it would in a full-image scale, so the scaled image can be updated
+ * a piece at a time
+ */
+void svScaleImageRect (const unsigned char * src, int srcW, int srcH,
+    unsigned char * dst, int dstW, int dstH, int bpp,
+    int dx, int dy, int dw, int dh, bool fast, const SVScaleFormat * fmt)
+{
+    if (src == NULL || dst == NULL || srcW < 1 || srcH < 1 || dstW < 1 || dstH < 1
+        || (bpp != 2 && bpp != 4))
+        return;
+
+    // keep the rectangle inside the destination
+    if (dx < 0)
+    {
+        dw += dx;
+        dx = 0;
+    }
+
+    if (dy < 0)
+    {
+        dh += dy;
+        dy = 0;
+    }
+
+    if (dx + dw > dstW)
+        dw = dstW - dx;
+
+    if (dy + dh > dstH)
+        dh = dstH - dy;
+
+    if (dw < 1 || dh < 1)
+        return;
+
+    SVScaleFormat defaultFormat;
+
+    if (fmt == NULL)
+        fmt = &defaultFormat;
+
+    const SVScaleKernels * k = svScaleKernels();
+    const int nSrcStride = srcW * bpp;
+    const int nDstStride = dstW * bpp;
+
+    // nearest neighbour
+    if (fast == true)
+    {
+        std::vector<int> nXs(dw);
+
+        for (int x = 0; x < dw; x ++)
+            nXs[x] = svNearestSource(dx + x, srcW, dstW);
+
+        for (int y = dy; y < dy + dh; y ++)
+        {
+            const unsigned char * pRow = src + svNearestSource(y, srcH, dstH) * nSrcStride;
+            unsigned char * pOut = dst + y * nDstStride + dx * bpp;
+
+            if (bpp == 4)
+                k->nearest4(reinterpret_cast<const uint32_t *>(pRow), &nXs[0],
+                    reinterpret_cast<uint32_t *>(pOut), dw);
+            else
+                k->nearest2(reinterpret_cast<const uint16_t *>(pRow), &nXs[0],
+                    reinterpret_cast<uint16_t *>(pOut), dw);
+        }
+
+        return;
+    }
+
+    // bilinear, done as a vertical blend of the two source rows into 'row'
+    // followed by a horizontal blend out of it
+    std::vector<int> nX0s(dw);
+    std::vector<int> nX1s(dw);
+    std::vector<int> nWXs(dw);
+
+    for (int x = 0; x < dw; x ++)
+        svBilinearSource(dx + x, srcW, dstW, nX0s[x], nX1s[x], nWXs[x]);
+
+    // only the source columns this rectangle samples get blended
+    const int nSpanX = nX0s[0];
+    const int nSpanW = nX1s[dw - 1] - nSpanX + 1;
+
+    for (int x = 0; x < dw; x ++)
+    {
+        nX0s[x] -= nSpanX;
+        nX1s[x] -= nSpanX;
+    }
+
+    std::vector<uint32_t> row(nSpanW);
+
+    for (int y = dy; y < dy + dh; y ++)
+    {
+        int nY0, nY1, nWY;
+
+        svBilinearSource(y, srcH, dstH, nY0, nY1, nWY);
+
+        const unsigned char * pRow0 = src + nY0 * nSrcStride + nSpanX * bpp;
+        const unsigned char * pRow1 = src + nY1 * nSrcStride + nSpanX * bpp;
+        unsigned char * pRow = reinterpret_cast<unsigned char *>(&row[0]);
+        unsigned char * pOut = dst + y * nDstStride + dx * bpp;
+
+        if (nWY == 0)
+            memcpy(pRow, pRow0, nSpanW * bpp);
+        else if (bpp == 4)
+            k->blendV4(pRow0, pRow1, pRow, nSpanW * 4, nWY);
+        else
+            k->blendV2(reinterpret_cast<const uint16_t *>(pRow0),
+                reinterpret_cast<const uint16_t *>(pRow1),
+                reinterpret_cast<uint16_t *>(pRow), nSpanW, nWY, fmt);
+
+        if (bpp == 4)
+            k->blendH4(reinterpret_cast<const uint32_t *>(pRow), &nX0s[0], &nX1s[0],
+                &nWXs[0], reinterpret_cast<uint32_t *>(pOut), dw);
+        else
+            k->blendH2(reinterpret_cast<const uint16_t *>(pRow), &nX0s[0], &nX1s[0],
+                &nWXs[0], reinterpret_cast<uint16_t *>(pOut), dw, fmt);
+    }
+}
+
+
+/*
+ * convert a rectangle of a srcW x srcH image into the rectangle of its
+ * dstW x dstH scaled copy that it affects (with a pixel of slack for bilinear)
+ */
+void svScaledRectBounds (int srcW, int srcH, int dstW, int dstH,
+    int& x, int& y, int& w, int& h)
+{
+    if (srcW < 1 || srcH < 1)
+    {
+        w = h = 0;
+        return;
+    }
+
+    int64_t nX0 = static_cast<int64_t>(x - 1) * dstW / srcW - 1;
+    int64_t nY0 = static_cast<int64_t>(y - 1) * dstH / srcH - 1;
+    int64_t nX1 = static_cast<int64_t>(x + w + 1) * dstW / srcW + 2;
+    int64_t nY1 = static_cast<int64_t>(y + h + 1) * dstH / srcH + 2;
+
+    if (nX0 < 0)
+        nX0 = 0;
+
+    if (nY0 < 0)
+        nY0 = 0;
+
+    if (nX1 > dstW)
+        nX1 = dstW;
+
+    if (nY1 > dstH)
+        nY1 = dstH;
+
+    x = static_cast<int>(nX0);
+    y = static_cast<int>(nY0);
+    w = static_cast<int>(nX1 - nX0);
+    h = static_cast<int>(nY1 - nY0);
+}
@@ -0,0 +1,72 @@
+/*
+ * scale.h - part of SpiritVNC - FLTK
+ * 2016-2021 Will Brokenbourgh https://www.pismotek.com/brainout/
+ */
+
+/*
+ * (C) Will Brokenbourgh
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of
+ * conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of
+ * conditions and the following disclaimer in the documentation and/or other materials provided
+ * with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used
+ * to endorse or promote products derived from this software without specific prior written
+ * permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef SCALE_H
+#define SCALE_H
+
+// scaling kernel levels
+#define SV_SCALE_AUTO   -1
+#define SV_SCALE_SCALAR 0
+#define SV_SCALE_SSE2   1
+#define SV_SCALE_AVX2   2
+
+/* channel layout of 2-byte pixels (not used for 4-byte pixels) */
+class SVScaleFormat
+{
+public:
+    SVScaleFormat () :
+        redShift(11),
+        greenShift(5),
+        blueShift(0),
+        redMax(31),
+        greenMax(63),
+        blueMax(31)
+    {}
+
+    int redShift;
+    int greenShift;
+    int blueShift;
+    int redMax;
+    int greenMax;
+    int blueMax;
+};
+
+void svScaleImageRect (const unsigned char *, int, int, unsigned char *, int, int, int,
+    int, int, int, int, bool, const SVScaleFormat *);
+void svScaledRectBounds (int, int, int, int, int&, int&, int&, int&);
+int svScaleSetLevel (int);
+int svScaleLevel ();
+const char * svScaleLevelName (int);
+
+#endif
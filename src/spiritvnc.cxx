@@ -59,6 +59,9 @@ int main (int argc, char **argv)
     // tells FLTK we're a multithreaded app
     Fl::lock();
 
+    // seed the random waits 'connect all' puts between hosts
+    srand(time(NULL));
+
     // set graphics / display options
     Fl::visual(FL_DOUBLE | FL_RGB);
 
@@ -124,6 +127,9 @@ int main (int argc, char **argv)
     // near 1 second
     Fl::add_timeout(SV_ONE_SECOND, svConnectionWatcher);
 
+    // start checking in the background which hosts can be reached
+    Fl::add_timeout(SV_ONE_SECOND, svProbeTimer);
+
     // start watching the clipboard
     Fl::add_clipboard_notify(svHandleLocalClipboard);
 
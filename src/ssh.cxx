@@ -39,16 +39,90 @@
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <pthread.h>
-#include <sys/select.h>
+#include <poll.h>
+#include <algorithm>
 #include <libssh2.h>
 
 
-/* create ssh session and ssh forwarding */
-/* (this is called as a thread because it blocks) */
-void * svCreateSSHConnection (void * data)
+/*
+ * wait for a socket during ssh setup, in short slices so a stop request for
+ * the host's attempt is noticed.  With a session, waits the way libssh2 says
+ * it's blocked; without one, for a connect to finish.  False once the
+ * deadline passes or the attempt is stopped
+ */
+bool svSSHSetupWait (HostItem * itm, int nAttempt, LIBSSH2_SESSION * sshSession, int sock,
+    long nDeadline)
 {
-    pthread_detach(pthread_self());
+    struct pollfd pfdSSH;
+
+    pfdSSH.fd = sock;
+    pfdSSH.events = POLLOUT;
+    pfdSSH.revents = 0;
+
+    if (sshSession != NULL)
+    {
+        int nDirections = libssh2_session_block_directions(sshSession);
+
+        pfdSSH.events = 0;
+
+        if (nDirections & LIBSSH2_SESSION_BLOCK_INBOUND)
+            pfdSSH.events |= POLLIN;
+
+        if (nDirections & LIBSSH2_SESSION_BLOCK_OUTBOUND)
+            pfdSSH.events |= POLLOUT;
+
+        if (pfdSSH.events == 0)
+            pfdSSH.events = POLLIN;
+    }
+
+    while (itm->sshStopAttempt != nAttempt)
+    {
+        long nWait = nDeadline - svMonotonicMs();
+
+        if (nWait <= 0)
+            return false;
+
+        int rc = poll(&pfdSSH, 1, static_cast<int>(std::min(nWait,
+            static_cast<long>(SV_SSH_SETUP_POLL_MS))));
+
+        if (rc > 0)
+            return true;
+
+        if (rc < 0 && errno != EINTR)
+            return false;
+    }
+
+    return false;
+}
+
+
+/* give up on a session that never finished setting up, and its socket */
+void svSSHAbandonSession (LIBSSH2_SESSION * sshSession, int sock, const char * strReason)
+{
+    if (sshSession != NULL)
+    {
+        // (blocking again, but not for long)
+        libssh2_session_set_blocking(sshSession, 1);
+        libssh2_session_set_timeout(sshSession, SV_SSH_CLOSE_TIMEOUT_MS);
 
+        if (strReason != NULL)
+            libssh2_session_disconnect(sshSession, strReason);
+
+        libssh2_session_free(sshSession);
+    }
+
+    if (sock != -1)
+        close(sock);
+}
+
+
+/*
+ * connect and log in to a host's ssh server, for a new pooled session.
+ * Every step is non-blocking, and gives up at nDeadline or when the host's
+ * attempt is stopped
+ */
+bool svSSHOpenSession (HostItem * itm, SshSession * ssh, int nAttempt, long nDeadline)
+{
     const unsigned int LIBSSH2_INADDR_NONE = (in_addr_t) - 1;
 
     enum {
@@ -58,67 +132,54 @@ void * svCreateSSHConnection (void * data)
     };
 
     int sockSSHSock = -1;
-    int sockSSHListenSock = -1;
-    int sockSSHForwardSock = -1;
-    int i = 0;
     int nSSHAuthType = LIBSSH2_AUTH_NONE;
-    int nSSHSockOption;
-    int nLoopErrors;
-    int nLoopErrorLimit = 100;
-    unsigned int nSSHLocalPort = 0;
-    ssize_t sztSSHLen;
-    ssize_t sztSSHWr;
+    int rc = 0;
 
-    char * strSSHLocalAddress = NULL;
-    char sshBuffer[16384] = {0};
     char * strUserAuthList = NULL;
-    std::string strError;
     bool authError = false;
 
     LIBSSH2_SESSION * sshSession = NULL;
-    LIBSSH2_CHANNEL * sshChannel = NULL;
-    fd_set structSSHSockSet;
     struct sockaddr_in structSSHSockAddress;
-    struct timeval structSSHTimeVal;
-    socklen_t sltSSHSockAddressLength = 0;
-
-    bool sshError = false;
 
-    HostItem * itm = static_cast<HostItem *>(data);
-
-    if (itm == NULL)
-        return SV_RET_VOID;
+    memset(&structSSHSockAddress, 0, sizeof(structSSHSockAddress));
+    structSSHSockAddress.sin_family = AF_INET;
 
-    // initialize the libssh library
-    if (libssh2_init(0) != 0)
+    if ((structSSHSockAddress.sin_addr.s_addr = inet_addr(itm->hostAddress.c_str())) ==
+        LIBSSH2_INADDR_NONE)
     {
-        svDebugLog("svCreateSSHConnection - ERROR - library initialization failed");
-        svMessageWindow("Error: Could not initialize libssh2");
-        itm->hasError = true;
-        return SV_RET_VOID;
+        svDebugLog("svSSHOpenSession - ERROR - Bad SSH server address");
+        svSSHSetupError(itm, nAttempt);
+        return false;
     }
 
+    // set port
+    structSSHSockAddress.sin_port = htons(atoi(itm->sshPort.c_str()));
+
     // connect to SSH server
     sockSSHSock = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
-    structSSHSockAddress.sin_family = AF_INET;
 
-    if ((structSSHSockAddress.sin_addr.s_addr = inet_addr(itm->hostAddress.c_str())) ==
-        LIBSSH2_INADDR_NONE)
+    if (sockSSHSock < 0)
     {
-        svDebugLog("svCreateSSHConnection - ERROR - Bad SSH server address");
-        itm->hasError = true;
-        return SV_RET_VOID;
+        svDebugLog("svSSHOpenSession - ERROR - Could not create a socket");
+        svSSHSetupError(itm, nAttempt);
+        return false;
     }
 
-    // set port
-    structSSHSockAddress.sin_port = htons(atoi(itm->sshPort.c_str()));
+    fcntl(sockSSHSock, F_SETFL, fcntl(sockSSHSock, F_GETFL, 0) | O_NONBLOCK);
+
+    int nSockError = 0;
+    socklen_t nLen = sizeof(nSockError);
 
-    if (connect(sockSSHSock, reinterpret_cast<sockaddr *>(&structSSHSockAddress),
-        sizeof(sockaddr_in)) != 0)
+    if ((connect(sockSSHSock, reinterpret_cast<sockaddr *>(&structSSHSockAddress),
+        sizeof(sockaddr_in)) != 0 && errno != EINPROGRESS)
+        || svSSHSetupWait(itm, nAttempt, NULL, sockSSHSock, nDeadline) == false
+        || getsockopt(sockSSHSock, SOL_SOCKET, SO_ERROR, &nSockError, &nLen) != 0
+        || nSockError != 0)
     {
-        svDebugLog("svCreateSSHConnection - ERROR - Could not connect to SSH server");
+        svDebugLog("svSSHOpenSession - ERROR - Could not connect to SSH server");
+        close(sockSSHSock);
         // don't change itm state for this one
-        return SV_RET_VOID;
+        return false;
     }
 
     /* Create a session instance */
@@ -126,40 +187,68 @@ void * svCreateSSHConnection (void * data)
 
     if (sshSession == NULL)
     {
-        svDebugLog("svCreateSSHConnection - ERROR - Could not initialize SSH session");
-        itm->hasError = true;
-        return SV_RET_VOID;
+        svDebugLog("svSSHOpenSession - ERROR - Could not initialize SSH session");
+        close(sockSSHSock);
+        svSSHSetupError(itm, nAttempt);
+        return false;
     }
 
+    // (the session stays non-blocking once it's shared, too)
+    libssh2_session_set_blocking(sshSession, 0);
+
+    svSSHSetupState(itm, nAttempt, SV_CONN_SSH_HANDSHAKE);
+
     // starts SSH session - this trades welcome banners, exchanges keys,
     // sets up crypto, compression, and MAC layers
-    if (libssh2_session_handshake(sshSession, sockSSHSock) != 0)
+    while ((rc = libssh2_session_handshake(sshSession, sockSSHSock)) == LIBSSH2_ERROR_EAGAIN)
+        if (svSSHSetupWait(itm, nAttempt, sshSession, sockSSHSock, nDeadline) == false)
+            break;
+
+    if (rc != 0)
     {
-        svDebugLog("svCreateSSHConnection - ERROR - Error when starting up SSH session");
-        if (sshSession != NULL)
-            libssh2_session_free(sshSession);
-        itm->hasError = true;
-        return SV_RET_VOID;
+        svDebugLog("svSSHOpenSession - ERROR - Error when starting up SSH session");
+        svSSHAbandonSession(sshSession, sockSSHSock, NULL);
+        svSSHSetupError(itm, nAttempt);
+        return false;
     }
 
+    svSSHSetupState(itm, nAttempt, SV_CONN_SSH_AUTH);
+
     // check which authentication methods are available
-    strUserAuthList = libssh2_userauth_list(sshSession, itm->sshUser.c_str(), itm->sshUser.size());
+    while ((strUserAuthList = libssh2_userauth_list(sshSession, itm->sshUser.c_str(),
+        itm->sshUser.size())) == NULL
+        && libssh2_session_last_errno(sshSession) == LIBSSH2_ERROR_EAGAIN)
+        if (svSSHSetupWait(itm, nAttempt, sshSession, sockSSHSock, nDeadline) == false)
+            break;
+
+    // (no list and no error means the server let us in without any)
+    if (strUserAuthList == NULL && libssh2_userauth_authenticated(sshSession) == 0)
+    {
+        svDebugLog("svSSHOpenSession - ERROR - Could not get the authentication methods");
+        svSSHAbandonSession(sshSession, sockSSHSock, "SpiritVNC could not log in");
+        svSSHSetupError(itm, nAttempt);
+        return false;
+    }
 
     // add 'password' authentication to our bitmap
-    if (strstr(strUserAuthList, "password"))
+    if (strUserAuthList != NULL && strstr(strUserAuthList, "password"))
         nSSHAuthType |= LIBSSH2_AUTH_PASSWORD;
 
     // add 'public key' authentication to our bitmap
-    if (strstr(strUserAuthList, "publickey"))
+    if (strUserAuthList != NULL && strstr(strUserAuthList, "publickey"))
         nSSHAuthType |= LIBSSH2_AUTH_PUBLICKEY;
 
     // try password authentication
     if (nSSHAuthType & LIBSSH2_AUTH_PASSWORD)
     {
-        if (libssh2_userauth_password(sshSession, itm->sshUser.c_str(),
-            itm->sshPass.c_str()) != 0)
+        while ((rc = libssh2_userauth_password(sshSession, itm->sshUser.c_str(),
+            itm->sshPass.c_str())) == LIBSSH2_ERROR_EAGAIN)
+            if (svSSHSetupWait(itm, nAttempt, sshSession, sockSSHSock, nDeadline) == false)
+                break;
+
+        if (rc != 0)
         {
-            svDebugLog("svCreateSSHConnection - ERROR - Authentication by password failed");
+            svDebugLog("svSSHOpenSession - ERROR - Authentication by password failed");
             authError = true;
         }
     }
@@ -169,11 +258,15 @@ void * svCreateSSHConnection (void * data)
     {
         authError = false;
 
-        if (libssh2_userauth_publickey_fromfile(sshSession, itm->sshUser.c_str(),
+        while ((rc = libssh2_userauth_publickey_fromfile(sshSession, itm->sshUser.c_str(),
                 itm->sshKeyPublic.c_str(), itm->sshKeyPrivate.c_str(),
-                    itm->sshPass.c_str()) != 0)
+                    itm->sshPass.c_str())) == LIBSSH2_ERROR_EAGAIN)
+            if (svSSHSetupWait(itm, nAttempt, sshSession, sockSSHSock, nDeadline) == false)
+                break;
+
+        if (rc != 0)
         {
-            svDebugLog("svCreateSSHConnection -  ERROR - Authentication by public key failed");
+            svDebugLog("svSSHOpenSession -  ERROR - Authentication by public key failed");
             authError = true;
         }
     }
@@ -181,244 +274,735 @@ void * svCreateSSHConnection (void * data)
     // no authorization methods were successful
     if (authError == true)
     {
-        svDebugLog("svCreateSSHConnection - ERROR - All supported authentication"
+        svDebugLog("svSSHOpenSession - ERROR - All supported authentication"
             " methods failed");
-        sshError = true;
+        svSSHAbandonSession(sshSession, sockSSHSock, "SpiritVNC could not log in");
+        svSSHSetupError(itm, nAttempt);
+        return false;
     }
 
-    if (sshError == false)
-    {
-        sockSSHListenSock = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
-        structSSHSockAddress.sin_family = AF_INET;
-        structSSHSockAddress.sin_port = htons(itm->sshLocalPort);
+    ssh->session = sshSession;
+    ssh->sock = sockSSHSock;
 
-        if ((structSSHSockAddress.sin_addr.s_addr = inet_addr("127.0.0.1")) == LIBSSH2_INADDR_NONE)
+    return true;
+
+}
+
+
+/*
+ * get an authenticated ssh session for a host, sharing one that's already
+ * open to the same server with the same credentials.  If another host is
+ * still logging in to it, wait for that instead of logging in again
+ * (blocks until nDeadline at most, or until the host's attempt is stopped)
+ */
+SshSession * svSSHGetSession (HostItem * itm, int nAttempt, long nDeadline)
+{
+    std::string strKey = itm->hostAddress + ":" + itm->sshPort + "\n" + itm->sshUser + "\n" +
+        itm->sshPass + "\n" + itm->sshKeyPublic + "\n" + itm->sshKeyPrivate;
+
+    SshSession * ssh = NULL;
+
+    pthread_mutex_lock(&app->sshTunnelsMutex);
+
+    for (size_t i = 0; i < app->sshSessions.size(); i ++)
+    {
+        if (app->sshSessions[i]->key == strKey && app->sshSessions[i]->failed == false)
         {
-            svDebugLog("svCreateSSHConnection - ERROR - Bad local/machine address");
-            sshError = true;
+            ssh = app->sshSessions[i];
+            break;
         }
     }
 
-    if (sshError == false)
+    // join an existing session
+    if (ssh != NULL)
     {
-        nSSHSockOption = 1;
+        ssh->refCount ++;
+
+        // (svSSHStop wakes us too)
+        while (ssh->ready == false && ssh->failed == false
+            && itm->sshStopAttempt != nAttempt)
+        {
+            long nWait = nDeadline - svMonotonicMs();
 
-        setsockopt(sockSSHListenSock, SOL_SOCKET, SO_REUSEADDR, &nSSHSockOption,
-            sizeof(nSSHSockOption));
+            if (nWait <= 0)
+                break;
 
-        sltSSHSockAddressLength = sizeof(structSSHSockAddress);
+            struct timespec tsUntil;
 
-        if (bind(sockSSHListenSock, reinterpret_cast<sockaddr *>(&structSSHSockAddress),
-            sltSSHSockAddressLength) == -1)
+            clock_gettime(CLOCK_REALTIME, &tsUntil);
+            tsUntil.tv_sec += nWait / 1000;
+            tsUntil.tv_nsec += (nWait % 1000) * 1000000L;
+
+            if (tsUntil.tv_nsec >= 1000000000L)
+            {
+                tsUntil.tv_sec ++;
+                tsUntil.tv_nsec -= 1000000000L;
+            }
+
+            pthread_cond_timedwait(&app->sshSessionsCond, &app->sshTunnelsMutex, &tsUntil);
+        }
+
+        bool failed = (ssh->ready == false);
+
+        pthread_mutex_unlock(&app->sshTunnelsMutex);
+
+        if (failed == true)
         {
-            svDebugLog("svCreateSSHConnection - ERROR - Could not bind to local"
-                " machine address");
-            sshError = true;
+            svDebugLog("svSSHGetSession - ERROR - Shared SSH session could not be opened");
+            svSSHReleaseSession(ssh);
+            svSSHSetupError(itm, nAttempt);
+            return NULL;
         }
+
+        svDebugLog("svSSHGetSession - Sharing the SSH session to " + itm->hostAddress);
+
+        return ssh;
     }
 
-    if (sshError == false)
+    // first host for this server, so log in while any others wait
+    ssh = new SshSession();
+    ssh->key = strKey;
+    ssh->refCount = 1;
+    app->sshSessions.push_back(ssh);
+
+    pthread_mutex_unlock(&app->sshTunnelsMutex);
+
+    bool opened = svSSHOpenSession(itm, ssh, nAttempt, nDeadline);
+
+    pthread_mutex_lock(&app->sshTunnelsMutex);
+
+    if (opened == true)
+        ssh->ready = true;
+    else
+        ssh->failed = true;
+
+    pthread_cond_broadcast(&app->sshSessionsCond);
+    pthread_mutex_unlock(&app->sshTunnelsMutex);
+
+    if (opened == false)
     {
-        if (listen(sockSSHListenSock, 2) == -1)
-        {
-            svDebugLog("svCreateSSHConnection - ERROR - Could not listen on local"
-                " machine address");
-            sshError = true;
-        }
+        svSSHReleaseSession(ssh);
+        return NULL;
     }
 
-    if (sshError == false)
+    return ssh;
+}
+
+
+/* drop a host's hold on a pooled ssh session, closing it after the last one */
+void svSSHReleaseSession (SshSession * ssh)
+{
+    if (ssh == NULL)
+        return;
+
+    pthread_mutex_lock(&app->sshTunnelsMutex);
+
+    ssh->refCount --;
+
+    bool lastUser = (ssh->refCount <= 0);
+
+    if (lastUser == true)
+        app->sshSessions.erase(std::remove(app->sshSessions.begin(), app->sshSessions.end(),
+            ssh), app->sshSessions.end());
+
+    pthread_mutex_unlock(&app->sshTunnelsMutex);
+
+    if (lastUser == false)
+        return;
+
+    if (ssh->session != NULL)
+    {
+        // nobody else is using it now (and a server that's gone away
+        // mustn't hold up the pump thread)
+        libssh2_session_set_blocking(ssh->session, 1);
+        libssh2_session_set_timeout(ssh->session, SV_SSH_CLOSE_TIMEOUT_MS);
+        libssh2_session_disconnect(ssh->session, "SpiritVNC disconnected normally");
+        libssh2_session_free(ssh->session);
+    }
+
+    if (ssh->sock != -1)
+        close(ssh->sock);
+
+    delete ssh;
+}
+
+
+/*
+ * open a forwarding channel on a shared session.  The pump thread may be
+ * using the session too, so this takes its lock and waits on the socket
+ * between tries instead of blocking
+ */
+LIBSSH2_CHANNEL * svSSHOpenChannel (SshSession * ssh, HostItem * itm, int nAttempt,
+    long nDeadline)
+{
+    LIBSSH2_CHANNEL * sshChannel = NULL;
+    struct pollfd pfdSSH;
+
+    while (itm->sshStopAttempt != nAttempt && svMonotonicMs() < nDeadline)
     {
-        strError = "svCreateSSHConnection - Waiting for SpiritVNC to connect on " +
-            std::string(inet_ntoa(structSSHSockAddress.sin_addr)) + ":" +
-            std::to_string(ntohs(structSSHSockAddress.sin_port));
+        pthread_mutex_lock(&ssh->mutex);
 
-        svDebugLog(strError);
+        // (the originator is only informational, there's no local listener now)
+        sshChannel = libssh2_channel_direct_tcpip_ex(ssh->session, "localhost",
+            atoi(itm->vncPort.c_str()), "127.0.0.1", 0);
+
+        int nError = libssh2_session_last_errno(ssh->session);
+        int nDirections = libssh2_session_block_directions(ssh->session);
+
+        pthread_mutex_unlock(&ssh->mutex);
+
+        if (sshChannel != NULL || nError != LIBSSH2_ERROR_EAGAIN)
+            break;
+
+        pfdSSH.fd = ssh->sock;
+        pfdSSH.events = POLLIN;
+        pfdSSH.revents = 0;
+
+        if (nDirections & LIBSSH2_SESSION_BLOCK_OUTBOUND)
+            pfdSSH.events |= POLLOUT;
+
+        // (short, as the pump thread may read the reply off the socket first)
+        poll(&pfdSSH, 1, SV_SSH_CHANNEL_POLL_MS);
+    }
+
+    return sshChannel;
+}
+
+
+/*
+ * create ssh forwarding over a (possibly shared) ssh session, then hand the
+ * tunnel to the shared ssh pump thread
+ * (this is called as a thread because it blocks)
+ */
+void * svCreateSSHConnection (void * data)
+{
+    pthread_detach(pthread_self());
+
+    int sockSSHForwardSock = -1;
+    std::string strError;
+
+    SshSession * ssh = NULL;
+    LIBSSH2_CHANNEL * sshChannel = NULL;
+
+    bool sshError = false;
+
+    HostItem * itm = static_cast<HostItem *>(data);
+
+    if (itm == NULL)
+        return SV_RET_VOID;
+
+    // the attempt this thread belongs to, so a stale thread can't touch the
+    // state of a newer connection to the same host
+    int nAttempt = itm->connectAttempt;
+
+    // the whole setup, however many steps it takes, gets this long
+    long nDeadline = svMonotonicMs() + app->nConnectionTimeout * 1000L;
+
+    itm->sshBytesIn = 0;
+    itm->sshBytesOut = 0;
+
+    // our end of the viewer's socket pair is ours to close from here
+    sockSSHForwardSock = itm->sshForwardSock;
+    itm->sshForwardSock = -1;
+
+    // initialize the libssh library
+    if (libssh2_init(0) != 0)
+    {
+        svDebugLog("svCreateSSHConnection - ERROR - library initialization failed");
+        svMessageWindow("Error: Could not initialize libssh2");
+        svSSHSetupError(itm, nAttempt);
+        close(sockSSHForwardSock);
+        svSSHSetupState(itm, nAttempt, SV_CONN_FAILED);
+        return SV_RET_VOID;
+    }
+
+    ssh = svSSHGetSession(itm, nAttempt, nDeadline);
+
+    if (ssh == NULL)
+    {
+        close(sockSSHForwardSock);
+        libssh2_exit();
+        svSSHSetupState(itm, nAttempt, SV_CONN_FAILED);
+        return SV_RET_VOID;
+    }
+
+    strError = "svCreateSSHConnection - Forwarding SpiritVNC to remote localhost:" +
+        itm->vncPort;
+
+    svDebugLog(strError);
 
+    svSSHSetupState(itm, nAttempt, SV_CONN_SSH_CHANNEL);
+
+    sshChannel = svSSHOpenChannel(ssh, itm, nAttempt, nDeadline);
+
+    if (sshChannel == NULL)
+    {
+        svDebugLog("svCreateSSHConnection - ERROR - Could not open the"
+            " direct-TCP/IP channel");
+        sshError = true;
+    }
+
+    // hand the tunnel's sockets and session to the shared ssh pump thread
+    SshTunnel * tunnel = new SshTunnel();
+
+    tunnel->itm = itm;
+    tunnel->nAttempt = nAttempt;
+    tunnel->ssh = ssh;
+    tunnel->channel = sshChannel;
+    tunnel->forwardSock = sockSSHForwardSock;
+
+    if (sshError == true)
+    {
+        svSSHCloseTunnel(tunnel, true);
+        svSSHSetupState(itm, nAttempt, SV_CONN_FAILED);
+        return SV_RET_VOID;
+    }
+
+    svLogToFile("SpiritVNC - SSH connection established with "
+        + itm->name + " - " + itm->hostAddress);
+
+    // (the session is already non-blocking, see svSSHOpenSession)
+    fcntl(sockSSHForwardSock, F_SETFL, fcntl(sockSSHForwardSock, F_GETFL, 0) | O_NONBLOCK);
+
+    svSSHAddTunnel(tunnel);
+
+    // (lets the viewer start talking to the host)
+    svSSHSetupState(itm, nAttempt, SV_CONN_SSH_READY);
+
+    return SV_RET_VOID;
+}
+
+
+/*
+ * move a host's connection along from its ssh setup thread, and wake the
+ * main thread once setup has finished either way.  Does nothing if the
+ * host has started a newer connection since this one
+ */
+void svSSHSetupState (HostItem * itm, int nAttempt, int nState)
+{
+    if (itm->connectAttempt != nAttempt)
+        return;
+
+    if (nState == SV_CONN_SSH_READY)
         itm->sshReady = true;
 
-        sockSSHForwardSock = accept(
-            sockSSHListenSock,
-            reinterpret_cast<sockaddr *>(&structSSHSockAddress),
-            &sltSSHSockAddressLength);
+    svSetConnectState(itm, nState);
 
-        if (sockSSHForwardSock == -1)
+    if (nState == SV_CONN_SSH_READY || nState == SV_CONN_FAILED)
+        Fl::awake(svHandleSSHConnection, itm);
+}
+
+
+/* flag an ssh setup error on a host, unless it has started a newer connection */
+void svSSHSetupError (HostItem * itm, int nAttempt)
+{
+    if (itm->connectAttempt == nAttempt)
+        itm->hasError = true;
+}
+
+
+/* give an established tunnel to the ssh pump thread, starting it if needed */
+void svSSHAddTunnel (SshTunnel * tunnel)
+{
+    bool pumpFailed = false;
+
+    pthread_mutex_lock(&app->sshTunnelsMutex);
+
+    app->sshTunnels.push_back(tunnel);
+
+    if (app->sshPumpRunning == false)
+    {
+        if (pipe(app->sshPumpWakePipe) == 0)
         {
-            svDebugLog("svCreateSSHConnection - ERROR - Forwarding not accepted");
-            sshError = true;
+            fcntl(app->sshPumpWakePipe[0], F_SETFL, O_NONBLOCK);
+            fcntl(app->sshPumpWakePipe[1], F_SETFL, O_NONBLOCK);
         }
+        else
+        {
+            app->sshPumpWakePipe[0] = -1;
+            app->sshPumpWakePipe[1] = -1;
+        }
+
+        if (pthread_create(&app->sshPumpThread, NULL, svSSHPumpThread, NULL) == 0)
+            app->sshPumpRunning = true;
+        else
+        {
+            svDebugLog("svSSHAddTunnel - ERROR - Could not start the ssh pump thread");
+            app->sshTunnels.pop_back();
+            pumpFailed = true;
+        }
+    }
+
+    pthread_mutex_unlock(&app->sshTunnelsMutex);
+
+    if (pumpFailed == true)
+    {
+        svSSHCloseTunnel(tunnel, true);
+        return;
     }
 
+    svSSHWakePump();
+}
+
+
+/*
+ * shut down a tunnel and let its host item know, if the host is still on
+ * the connection the tunnel was made for
+ */
+void svSSHCloseTunnel (SshTunnel * tunnel, bool sshError)
+{
+    if (tunnel == NULL)
+        return;
+
+    HostItem * itm = tunnel->itm;
+
     if (sshError == false)
+        svLogToFile("SSH connection disconnected normally from '"
+            + itm->name + "' - " + itm->hostAddress);
+    else
+        svLogToFile("SSH connection disconnected abnormally from '"
+            + itm->name + "' - " + itm->hostAddress);
+
+    if (itm->connectAttempt == tunnel->nAttempt)
     {
-        strSSHLocalAddress = inet_ntoa(structSSHSockAddress.sin_addr);
-        nSSHLocalPort = ntohs(structSSHSockAddress.sin_port);
+        if (sshError == true)
+            itm->hasError = true;
+
+        itm->sshReady = false;
+    }
 
-        strError = "svCreateSSHConnection - Forwarding connection from " +
-            std::string(strSSHLocalAddress) + ":" + std::to_string(nSSHLocalPort) +
-            " local to remote localhost:" + itm->vncPort;
+    // shutdown and clean up
+    close(tunnel->forwardSock);
 
-        svDebugLog(strError);
+    if (tunnel->channel != NULL)
+    {
+        pthread_mutex_lock(&tunnel->ssh->mutex);
 
-        sshChannel = libssh2_channel_direct_tcpip_ex(sshSession, "localhost",
-            atoi(itm->vncPort.c_str()), strSSHLocalAddress, nSSHLocalPort);
+        // (the session is non-blocking, and other tunnels may still be using it)
+        for (int i = 0; i < SV_SSH_LOOP_ERROR_LIMIT; i ++)
+            if (libssh2_channel_free(tunnel->channel) != LIBSSH2_ERROR_EAGAIN)
+                break;
 
-        if (sshChannel == NULL)
-        {
-            svDebugLog("svCreateSSHConnection - ERROR - Could not open the"
-                " direct-TCP/IP channel");
-            sshError = true;
-        }
+        pthread_mutex_unlock(&tunnel->ssh->mutex);
     }
 
-    if (sshError == false)
-        svLogToFile("SpiritVNC - SSH connection established with "
-            + itm->name + " - " + itm->hostAddress);
+    svSSHReleaseSession(tunnel->ssh);
 
-    // use non-blocking IO from here (due to current libssh2 API)
-    libssh2_session_set_blocking(sshSession, 0);
+    libssh2_exit();
+
+    delete tunnel;
+}
 
-    while (sshError == false && itm->stopSSH == false)
+
+/*
+ * move whatever is ready between one tunnel's viewer socket and its ssh
+ * channel, without blocking.  Returns false once the tunnel is finished
+ */
+bool svSSHPumpTunnel (SshTunnel * tunnel)
+{
+    HostItem * itm = tunnel->itm;
+    std::string strError;
+    ssize_t sztSSHLen;
+
+    if (itm->sshStopAttempt == tunnel->nAttempt)
+        return false;
+
+    // viewer to server (only read more once the last read is all written)
+    if (tunnel->toServerLen == 0)
     {
-        FD_ZERO(&structSSHSockSet);
-        FD_SET(sockSSHForwardSock, &structSSHSockSet);
+        sztSSHLen = recv(tunnel->forwardSock, tunnel->toServer, sizeof(tunnel->toServer), 0);
 
-        structSSHTimeVal.tv_sec = 0;
-        structSSHTimeVal.tv_usec = 5000;
+        if (sztSSHLen == 0)
+        {
+            strError = "svSSHPumpTunnel - SpiritVNC viewer disconnected from '" +
+                itm->name + "'";
 
-        int rc = select(sockSSHForwardSock + 1, &structSSHSockSet, NULL, NULL, &structSSHTimeVal);
+            svDebugLog(strError);
+            return false;
+        }
 
-        nLoopErrors = 0;
+        if (sztSSHLen < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+        {
+            svDebugLog("svSSHPumpTunnel - ERROR - Socket receive error");
+            tunnel->hasError = true;
+            return false;
+        }
 
-        if (rc == -1)
+        if (sztSSHLen > 0)
         {
-            svDebugLog("svCreateSSHConnection - ERROR - select() error on socket");
-            sshError = true;
-            break;
+            tunnel->toServerLen = sztSSHLen;
+            tunnel->toServerPos = 0;
         }
+    }
+
+    while (tunnel->toServerPos < tunnel->toServerLen)
+    {
+        sztSSHLen = libssh2_channel_write(tunnel->channel, tunnel->toServer + tunnel->toServerPos,
+            tunnel->toServerLen - tunnel->toServerPos);
+
+        // socket or channel window is full, so pick up here on the next wake
+        if (sztSSHLen == LIBSSH2_ERROR_EAGAIN)
+            break;
 
-        if (rc != 0 && FD_ISSET(sockSSHForwardSock, &structSSHSockSet))
+        if (sztSSHLen < 0)
         {
-            sztSSHLen = recv(sockSSHForwardSock, sshBuffer, sizeof(sshBuffer), 0);
+            svDebugLog("svSSHPumpTunnel - ERROR - libssh2_channel_write error");
+
+            // if we exceed the loop error limit, give up
+            tunnel->loopErrors ++;
 
-            if (sztSSHLen < 0)
+            if (tunnel->loopErrors > SV_SSH_LOOP_ERROR_LIMIT)
             {
-                svDebugLog("svCreateSSHConnection - ERROR - Socket receive error");
-                sshError = true;
-                break;
+                svDebugLog("svSSHPumpTunnel - sshError: channel write error");
+                tunnel->hasError = true;
+                tunnel->ssh->failed = true;
+                return false;
             }
-            else
-            if (sztSSHLen == 0)
-            {
-                strError = "svCreateSSHConnection - SpiritVNC viewer disconnected from " +
-                    std::string(strSSHLocalAddress) + ":" + std::to_string(nSSHLocalPort);
 
-                svDebugLog(strError);
-                break;
-            }
+            break;
+        }
 
-            sztSSHWr = 0;
+        tunnel->toServerPos += sztSSHLen;
+        tunnel->loopErrors = 0;
+        itm->sshBytesOut += sztSSHLen;
+    }
 
-            do
+    if (tunnel->toServerPos >= tunnel->toServerLen)
+    {
+        tunnel->toServerLen = 0;
+        tunnel->toServerPos = 0;
+    }
+
+    // server to viewer
+    while (true)
+    {
+        // what's left of the last read has to reach the viewer first
+        while (tunnel->toViewerPos < tunnel->toViewerLen)
+        {
+            sztSSHLen = send(tunnel->forwardSock, tunnel->toViewer + tunnel->toViewerPos,
+                tunnel->toViewerLen - tunnel->toViewerPos, 0);
+
+            if (sztSSHLen < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                return true;
+
+            if (sztSSHLen <= 0)
             {
-                i = libssh2_channel_write(sshChannel, sshBuffer, sztSSHLen);
+                svDebugLog("svSSHPumpTunnel - ERROR - Socket send error");
+                tunnel->hasError = true;
+                return false;
+            }
 
-                if (i < 0)
-                {
-                    svDebugLog("svCreateSSHConnection - ERROR - libssh2_channel_write error");
+            tunnel->toViewerPos += sztSSHLen;
+        }
 
-                    // if we exceed the loop error limit, give up
-                    nLoopErrors ++;
+        tunnel->toViewerLen = 0;
+        tunnel->toViewerPos = 0;
 
-                    if (nLoopErrors > nLoopErrorLimit)
-                    {
-                        sshError = true;
-                        svDebugLog("svCreateSSHConnection - sshError: channel write error");
-                        break;
-                    }
-                }
+        sztSSHLen = libssh2_channel_read(tunnel->channel, tunnel->toViewer,
+            sizeof(tunnel->toViewer));
+
+        if (sztSSHLen == LIBSSH2_ERROR_EAGAIN || sztSSHLen == 0)
+            break;
 
-                sztSSHWr += i;
+        if (sztSSHLen < 0)
+        {
+            svDebugLog("svSSHPumpTunnel - ERROR - libssh2_channel_read error");
+
+            // if we exceed the loop error limit, give up
+            tunnel->loopErrors ++;
 
-            } while (i > 0 && sztSSHWr < sztSSHLen);
+            if (tunnel->loopErrors > SV_SSH_LOOP_ERROR_LIMIT)
+            {
+                tunnel->hasError = true;
+                tunnel->ssh->failed = true;
+                return false;
+            }
 
-            nLoopErrors = 0;
+            break;
         }
 
-        while (sshError == false && itm->stopSSH == false)
+        tunnel->toViewerLen = sztSSHLen;
+        tunnel->loopErrors = 0;
+        itm->sshBytesIn += sztSSHLen;
+    }
+
+    if (libssh2_channel_eof(tunnel->channel))
+    {
+        strError = "svSSHPumpTunnel - The server at localhost:" +
+            itm->vncPort + " disconnected";
+
+        svDebugLog(strError);
+        tunnel->hasError = true;
+        return false;
+    }
+
+    return true;
+}
+
+
+/*
+ * the one thread that moves data for every ssh tunnel.  It sleeps in poll()
+ * until a viewer or ssh server sends something, libssh2 can carry on with
+ * a write it put off, or a tunnel is added or stopped
+ * (this is called as a thread and runs until the app exits)
+ */
+void * svSSHPumpThread (void * notUsed)
+{
+    pthread_detach(pthread_self());
+
+    std::vector<SshTunnel *> tunnels;
+    std::vector<SshTunnel *> finished;
+    std::vector<struct pollfd> pfds;
+    char wakeBuffer[64];
+
+    while (true)
+    {
+        pthread_mutex_lock(&app->sshTunnelsMutex);
+        tunnels = app->sshTunnels;
+        pthread_mutex_unlock(&app->sshTunnelsMutex);
+
+        pfds.resize(1 + tunnels.size() * 2);
+
+        pfds[0].fd = app->sshPumpWakePipe[0];
+        pfds[0].events = POLLIN;
+        pfds[0].revents = 0;
+
+        for (size_t i = 0; i < tunnels.size(); i ++)
         {
-            sztSSHLen = libssh2_channel_read(sshChannel, sshBuffer, sizeof(sshBuffer));
+            SshTunnel * tunnel = tunnels[i];
+            struct pollfd& pfdForward = pfds[1 + i * 2];
+            struct pollfd& pfdSSH = pfds[2 + i * 2];
 
-            if (sztSSHLen == LIBSSH2_ERROR_EAGAIN)
-                break;
-            else
-            if (sztSSHLen < 0)
-            {
-                svDebugLog("svCreateSSHConnection - ERROR - libssh2_channel_read error");
+            // (a viewer that isn't reading holds back the server side, and the other way round)
+            pfdForward.fd = tunnel->forwardSock;
+            pfdForward.events = 0;
+            pfdForward.revents = 0;
 
-                // if we exceed the loop error limit, give up
-                nLoopErrors ++;
+            if (tunnel->toServerLen == 0)
+                pfdForward.events |= POLLIN;
 
-                if (nLoopErrors > nLoopErrorLimit)
-                {
-                    sshError = true;
-                    break;
-                }
+            if (tunnel->toViewerLen > 0)
+                pfdForward.events |= POLLOUT;
+
+            pfdSSH.fd = tunnel->ssh->sock;
+            pfdSSH.events = POLLIN;
+            pfdSSH.revents = 0;
+
+            pthread_mutex_lock(&tunnel->ssh->mutex);
+
+            if (libssh2_session_block_directions(tunnel->ssh->session)
+                & LIBSSH2_SESSION_BLOCK_OUTBOUND)
+                pfdSSH.events |= POLLOUT;
+
+            pthread_mutex_unlock(&tunnel->ssh->mutex);
+        }
+
+        // the timeout only catches a stop request; the viewer closing its end normally wakes us first
+        int rc = poll(&pfds[0], pfds.size(), (tunnels.empty() == true ? -1 : SV_SSH_PUMP_TIMEOUT_MS));
+
+        if (rc == -1)
+        {
+            if (errno != EINTR)
+            {
+                svDebugLog("svSSHPumpThread - ERROR - poll() error on sockets");
+                usleep(SV_SSH_PUMP_TIMEOUT_MS * 1000);
             }
 
-            sztSSHWr = 0;
-            nLoopErrors = 0;
+            continue;
+        }
+
+        if (pfds[0].revents & POLLIN)
+            while (read(app->sshPumpWakePipe[0], wakeBuffer, sizeof(wakeBuffer)) > 0) {}
+
+        finished.clear();
+
+        for (size_t i = 0; i < tunnels.size(); i ++)
+        {
+            SshTunnel * tunnel = tunnels[i];
+
+            if (rc != 0 && pfds[1 + i * 2].revents == 0 && pfds[2 + i * 2].revents == 0
+                && tunnel->itm->sshStopAttempt != tunnel->nAttempt)
+                continue;
 
-            while (sztSSHWr < sztSSHLen)
+            pthread_mutex_lock(&tunnel->ssh->mutex);
+            bool keepGoing = svSSHPumpTunnel(tunnel);
+            pthread_mutex_unlock(&tunnel->ssh->mutex);
+
+            if (keepGoing == false)
+                finished.push_back(tunnel);
+        }
+
+        // reading one channel of a shared session can pull in data for another
+        // that the socket won't tell us about again, so collect it now
+        bool pumpedAny = true;
+
+        while (pumpedAny == true)
+        {
+            pumpedAny = false;
+
+            for (size_t i = 0; i < tunnels.size(); i ++)
             {
-                i = send(sockSSHForwardSock, sshBuffer + sztSSHWr, sztSSHLen - sztSSHWr, 0);
+                SshTunnel * tunnel = tunnels[i];
 
-                if (i <= 0)
+                if (tunnel->ssh->refCount < 2 || tunnel->toViewerLen > 0
+                    || std::find(finished.begin(), finished.end(), tunnel) != finished.end())
+                    continue;
+
+                pthread_mutex_lock(&tunnel->ssh->mutex);
+
+                if (libssh2_poll_channel_read(tunnel->channel, 0) != 0)
                 {
-                    svDebugLog("svCreateSSHConnection - ERROR - Socket send error");
-                    sshError = true;
-                    break;
+                    pumpedAny = true;
+
+                    if (svSSHPumpTunnel(tunnel) == false)
+                        finished.push_back(tunnel);
                 }
-                sztSSHWr += i;
+
+                pthread_mutex_unlock(&tunnel->ssh->mutex);
             }
+        }
 
-            if (libssh2_channel_eof(sshChannel))
-            {
-                strError = "svCreateSSHConnection - The server at localhost:" +
-                    itm->vncPort + " disconnected";
+        for (size_t i = 0; i < finished.size(); i ++)
+        {
+            SshTunnel * tunnel = finished[i];
 
-                svDebugLog(strError);
-                sshError = true;
-                break;
-            }
+            pthread_mutex_lock(&app->sshTunnelsMutex);
+            app->sshTunnels.erase(std::remove(app->sshTunnels.begin(), app->sshTunnels.end(),
+                tunnel), app->sshTunnels.end());
+            pthread_mutex_unlock(&app->sshTunnelsMutex);
+
+            svSSHCloseTunnel(tunnel, tunnel->hasError);
         }
     }
 
-    if (sshError == false)
-        svLogToFile("SSH connection disconnected normally from '"
-            + itm->name + "' - " + itm->hostAddress);
-    else
-    {
-        svLogToFile("SSH connection disconnected abnormally from '"
-            + itm->name + "' - " + itm->hostAddress);
-        itm->hasError = true;
-    }
+    return SV_RET_VOID;
+}
 
-    // shutdown and clean up
+
+/*
+ * stop a host's current ssh connection: its tunnel, or its setup if that
+ * hasn't finished (including waiting on another host's login)
+ */
+void svSSHStop (HostItem * itm)
+{
+    itm->sshStopAttempt = itm->connectAttempt.load();
     itm->sshReady = false;
-    close(sockSSHForwardSock);
-    close(sockSSHListenSock);
 
-    if (sshChannel != NULL)
-        libssh2_channel_free(sshChannel);
+    pthread_mutex_lock(&app->sshTunnelsMutex);
+    pthread_cond_broadcast(&app->sshSessionsCond);
+    pthread_mutex_unlock(&app->sshTunnelsMutex);
 
-    libssh2_session_disconnect(sshSession, "SpiritVNC disconnected normally");
-    libssh2_session_free(sshSession);
+    svSSHWakePump();
+}
 
-    close(sockSSHSock);
 
-    libssh2_exit();
-    itm->stopSSH = false;
+/* wake the ssh pump thread so it notices a new or stopped tunnel */
+void svSSHWakePump ()
+{
+    if (app->sshPumpWakePipe[1] == -1)
+        return;
 
-    return SV_RET_VOID;
+    // (a full pipe means it's going to wake anyway)
+    if (write(app->sshPumpWakePipe[1], "x", 1) < 0 && errno != EAGAIN)
+        svDebugLog("svSSHWakePump - Could not write to the wake pipe");
 }
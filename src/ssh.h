@@ -35,6 +35,91 @@
 #ifndef SSH_H
 #define SSH_H
 
+class HostItem;
+
+/*
+ * an authenticated ssh session, shared by every host that reaches the same
+ * server with the same credentials.  libssh2 sessions aren't thread safe,
+ * so all use of one after it's ready happens under its mutex
+ */
+class SshSession
+{
+public:
+    SshSession () :
+        key(""),
+        session(NULL),
+        sock(-1),
+        refCount(0),
+        ready(false),
+        failed(false)
+    {
+        pthread_mutex_init(&mutex, NULL);
+    }
+
+    ~SshSession ()
+    {
+        pthread_mutex_destroy(&mutex);
+    }
+
+    std::string key;
+    LIBSSH2_SESSION * session;
+    int sock;
+    int refCount;
+    bool ready;
+    bool failed;
+    pthread_mutex_t mutex;
+};
+
+/* an established ssh tunnel, serviced by the ssh pump thread */
+class SshTunnel
+{
+public:
+    SshTunnel () :
+        itm(NULL),
+        nAttempt(0),
+        ssh(NULL),
+        channel(NULL),
+        forwardSock(-1),
+        toServerLen(0),
+        toServerPos(0),
+        toViewerLen(0),
+        toViewerPos(0),
+        loopErrors(0),
+        hasError(false)
+    {}
+
+    HostItem * itm;
+    // the host's connection attempt this tunnel belongs to (see svSSHCloseTunnel)
+    int nAttempt;
+    SshSession * ssh;
+    LIBSSH2_CHANNEL * channel;
+    // our end of the socket pair the viewer's rfbClient talks through
+    int forwardSock;
+    // data read from one side that the other side hasn't taken yet
+    char toServer[16384];
+    ssize_t toServerLen;
+    ssize_t toServerPos;
+    char toViewer[16384];
+    ssize_t toViewerLen;
+    ssize_t toViewerPos;
+    int loopErrors;
+    bool hasError;
+};
+
 void * svCreateSSHConnection (void *);
+void svSSHAddTunnel (SshTunnel *);
+void svSSHCloseTunnel (SshTunnel *, bool);
+SshSession * svSSHGetSession (HostItem *, int, long);
+LIBSSH2_CHANNEL * svSSHOpenChannel (SshSession *, HostItem *, int, long);
+void svSSHAbandonSession (LIBSSH2_SESSION *, int, const char *);
+bool svSSHOpenSession (HostItem *, SshSession *, int, long);
+bool svSSHPumpTunnel (SshTunnel *);
+void * svSSHPumpThread (void *);
+void svSSHReleaseSession (SshSession *);
+void svSSHSetupError (HostItem *, int);
+void svSSHSetupState (HostItem *, int, int);
+bool svSSHSetupWait (HostItem *, int, LIBSSH2_SESSION *, int, long);
+void svSSHStop (HostItem *);
+void svSSHWakePump ();
 
 #endif
@@ -35,6 +35,7 @@
 #include "app.h"
 #include "consts_enums.h"
 #include "vnc.h"
+#include "xshm.h"
 
 
 /* create a listening vnc obect */
@@ -107,7 +108,11 @@ void VncObject::createVNCObject (HostItem * itm)
             return;
         }
 
-        // reset itm state flags
+        // reset itm state flags (a new attempt also leaves any stop request
+        // for the last one's ssh tunnel behind)
+        itm->connectAttempt ++;
+        itm->sshReady = false;
+        svSetConnectState(itm, SV_CONN_STARTING);
         itm->isConnecting = true;
         itm->isConnected = false;
         itm->isWaitingForShow = false;
@@ -136,7 +141,9 @@ void VncObject::createVNCObject (HostItem * itm)
         vnc->vncClient->appData.compressLevel = itm->compressLevel;
         vnc->vncClient->appData.qualityLevel = itm->qualityLevel;
 
-        vnc->vncClient->appData.encodingsString = strdup("tight copyrect hextile");
+        vnc->encodingsList = (itm->encodings != "" ? itm->encodings : SV_ENCODINGS);
+        vnc->hostEncodings = itm->encodings;
+        vnc->vncClient->appData.encodingsString = vnc->encodingsList.c_str();
 
         itm->vncAddressAndPort = itm->hostAddress + ":" + itm->vncPort;
 
@@ -171,19 +178,41 @@ void VncObject::createVNCObject (HostItem * itm)
                   "file for '" + itm->name + "' - " + itm->hostAddress);
 
                 if (vnc->vncClient != NULL)
-                    VncObject::endAndDeleteViewer(&vnc);
+                    VncObject::endAndDeleteViewer(&itm->vnc);
 
                 svHandleThreadConnection(itm);
 
                 return;
             }
 
-            itm->sshLocalPort = svFindFreeTcpPort();
+            // the viewer talks to its ssh tunnel over a socket pair instead of
+            // through a local tcp port
+            int sockPair[2];
 
-            itm->vncAddressAndPort = "127.0.0.1:" + std::to_string(itm->sshLocalPort);
+            if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockPair) != 0)
+            {
+                svLogToFile("ERROR - Couldn't create the SSH tunnel socket for '" + itm->name +
+                  "' - " + itm->hostAddress);
+                itm->isConnecting = false;
+                itm->hasCouldntConnect = true;
+                itm->hasError = true;
+
+                if (vnc != NULL && vnc->vncClient != NULL)
+                    VncObject::endAndDeleteViewer(&itm->vnc);
+
+                svHandleThreadConnection(itm);
+
+                return;
+            }
+
+            // (rfbClientCleanup closes the viewer's end)
+            vnc->vncClient->sock = sockPair[0];
+            itm->sshForwardSock = sockPair[1];
 
             svDebugLog("svCreateVNCObject - Creating and running threadSSH");
 
+            svSetConnectState(itm, SV_CONN_SSH_CONNECT);
+
             // create, launch and detach call to create our ssh connection
             int sshResult = pthread_create(&itm->threadSSH, NULL, svCreateSSHConnection, itm);
 
@@ -191,68 +220,92 @@ void VncObject::createVNCObject (HostItem * itm)
             {
                 svLogToFile("ERROR - Couldn't create SSH thread for '" + itm->name +
                   "' - " + itm->hostAddress);
+
+                close(itm->sshForwardSock);
+                itm->sshForwardSock = -1;
+
                 itm->isConnecting = false;
                 itm->hasCouldntConnect = true;
                 itm->hasError = true;
 
                 if (vnc != NULL && vnc->vncClient != NULL)
-                    VncObject::endAndDeleteViewer(&vnc);
+                    VncObject::endAndDeleteViewer(&itm->vnc);
 
                 svHandleThreadConnection(itm);
 
                 return;
             }
 
-            time_t timeOut = time(NULL) + (SV_CONNECTION_TIMEOUT_SECS - 1);
+            // the ssh thread reports back through svHandleSSHConnection, which starts
+            // the vnc side once the tunnel is up (svConnectionWatcher handles timeouts)
+        }
+        // ############  SSH CONNECTION END ###########################################
+        else
+        if (VncObject::startRFBConnection(itm) == false)
+            return;
+    }
 
-            svDebugLog("svCreateVNCObject - About to enter itm->sshReady timer loop");
+    // add to our count of created vncObjects
+    app->createdObjects ++;
 
-            // loop until the ssh connection is ready
-            // or exit if ssh times out
-            while (itm->sshReady == false)
-            {
-                if (time(NULL) >= timeOut)
-                {
-                    itm->isConnecting = false;
-                    itm->hasCouldntConnect = true;
+    return;
+}
 
-                    svHandleThreadConnection(itm);
 
-                    return;
-                }
+/*
+ * start the rfb stage of a host's connection, on its own thread
+ * (static method)
+ */
+bool VncObject::startRFBConnection (HostItem * itm)
+{
+    VncObject * vnc = itm->vnc;
 
-                Fl::check();
-            }
-        }
-        // ############  SSH CONNECTION END ###########################################
+    // ssh hosts are already connected, through their tunnel
+    if (itm->isListener == true)
+        svSetConnectState(itm, SV_CONN_LISTENING);
+    else if (itm->hostType == 's')
+        svSetConnectState(itm, SV_CONN_RFB_INIT);
+    else
+        svSetConnectState(itm, SV_CONN_VNC_CONNECT);
 
-        svDebugLog("svCreateVNCObject - Creating and running itm->threadRFB");
+    svDebugLog("startRFBConnection - Creating and running itm->threadRFB");
 
-        // create, launch and detach call to create our vnc connection
-        int rfbResult = pthread_create(&itm->threadRFB, NULL, VncObject::initVNCConnection, itm);
+    // lets endViewer wake the thread out of its connect
+    if (pipe(vnc->connectWakePipe) != 0)
+    {
+        svDebugLog("startRFBConnection - Could not create the wake pipe, connecting without");
+        vnc->connectWakePipe[0] = -1;
+        vnc->connectWakePipe[1] = -1;
+    }
 
-        if (rfbResult != 0)
-        {
-            svLogToFile("ERROR - Couldn't create RFB thread for '" + itm->name +
-                  "' - " + itm->hostAddress);
-            itm->isConnecting = false;
-            itm->hasCouldntConnect = true;
-            itm->hasError = true;
+    vnc->stopConnect = false;
+    vnc->connectOwnsClient = false;
 
-            if (vnc != NULL && vnc->vncClient != NULL)
-                VncObject::endAndDeleteViewer(&vnc);
+    // set before the thread exists so it's never ended without being told
+    vnc->connectRunning = true;
 
-            svHandleThreadConnection(itm);
+    // create, launch and detach call to create our vnc connection
+    int rfbResult = pthread_create(&itm->threadRFB, NULL, VncObject::initVNCConnection, vnc);
 
-            return;
-        }
-    }
+    if (rfbResult != 0)
+    {
+        vnc->connectRunning = false;
 
-    // add to our count of created vncObjects so we
-    // can stop 'expensive' stuff in masterMessageLoop
-    app->createdObjects ++;
+        svLogToFile("ERROR - Couldn't create RFB thread for '" + itm->name +
+              "' - " + itm->hostAddress);
+        itm->isConnecting = false;
+        itm->hasCouldntConnect = true;
+        itm->hasError = true;
 
-    return;
+        if (vnc != NULL && vnc->vncClient != NULL)
+            VncObject::endAndDeleteViewer(&itm->vnc);
+
+        svHandleThreadConnection(itm);
+
+        return false;
+    }
+
+    return true;
 }
 
 
@@ -279,7 +332,7 @@ void VncObject::endAllViewers ()
             {
                 itm->hasDisconnectRequest = true;
 
-                VncObject::endAndDeleteViewer(&vnc);
+                VncObject::endAndDeleteViewer(&itm->vnc);
             }
 
             vnc = NULL;
@@ -330,35 +383,52 @@ void VncObject::endViewer ()
             }
         }
 
-        // decrement our count of created vncObjects so we
-        // can check and avoid 'expensive' stuff in masterMessageLoop
+        // decrement our count of created vncObjects
         app->createdObjects --;
 
-        // stop this viewer's connection worker thread
-        if (itm->threadRFBRunning == true)
-        {
-            // make sure there's a valid thread before canceling
-            if (itm->threadRFB != 0)
-                pthread_cancel(itm->threadRFB);
-
-            itm->threadRFBRunning = false;
-        }
+        // stop this viewer's connection worker thread (endAndDeleteViewer
+        // leaves the client to it if it's still finishing up)
+        stopConnectThread();
 
         // tell ssh to clean up if a ssh/vnc connection
         if (itm->hostType == 's')
-        {
-            itm->stopSSH = true;
-            itm->sshReady = false;
-        }
+            svSSHStop(itm);
 
         itm->isConnected = false;
         itm->isConnecting = false;
         itm->hasDisconnectRequest = false;
         itm->hasEnded = true;
+        svSetConnectState(itm, SV_CONN_IDLE);
 
         // clean up the client
-        rfbClientCleanup(vncClient);
+        stopDecoderThread();
+        Fl::remove_timeout(VncObject::handlePresentTimer, this);
+        Fl::remove_timeout(VncObject::handlePointerTimer, this);
+        hasPendingMotion = false;
+        Fl::remove_timeout(VncObject::handleKeyTimer, this);
+        keySchedule.clear();
+        freeFrameBuffer();
+        freeScaledBuffer();
+    }
+}
+
+
+/* release the cached scaled image */
+/* (instance method) */
+void VncObject::freeScaledBuffer ()
+{
+    if (shmScaled != NULL)
+    {
+        svShmDestroy(shmScaled);
+        shmScaled = NULL;
     }
+    else if (scaledBuffer != NULL)
+        delete [] scaledBuffer;
+
+    scaledBuffer = NULL;
+    scaledW = 0;
+    scaledH = 0;
+    scaledValid = false;
 }
 
 
@@ -366,13 +436,36 @@ void VncObject::endViewer ()
 /* (static method) */
 void VncObject::endAndDeleteViewer (VncObject ** vnc)
 {
-    if (vnc == NULL)
+    if (vnc == NULL || *vnc == NULL)
         return;
 
-    (*vnc)->endViewer();
+    VncObject * oldVnc = *vnc;
+    HostItem * itm = oldVnc->itm;
+
+    oldVnc->endViewer();
+
+    // nothing may point at it from here on, whoever ends up deleting it
+    if (itm != NULL && itm->vnc == oldVnc)
+        itm->vnc = NULL;
 
-    delete *vnc;
     *vnc = NULL;
+
+    // a connection thread that's still finishing up gets the client and the
+    // viewer to clean up, so this is the last we touch it
+    pthread_mutex_lock(&oldVnc->bufferMutex);
+
+    bool handedOver = oldVnc->connectRunning;
+    oldVnc->connectOwnsClient = handedOver;
+
+    pthread_mutex_unlock(&oldVnc->bufferMutex);
+
+    if (handedOver == true)
+        return;
+
+    rfbClientCleanup(oldVnc->vncClient);
+    oldVnc->closeConnectWake();
+
+    delete oldVnc;
 }
 
 
@@ -397,104 +490,372 @@ bool VncObject::fitsScroller ()
 }
 
 
-/* handle cursor change */
+/*
+ * whether the viewer scales the host's screen: always for 'z'oom, when it's
+ * too big for 'f'it and for 'r'esize while the host's screen doesn't fit
+ * (mostly while a resize is on its way) or if the host won't resize
+ * (instance method)
+ */
+bool VncObject::isScaled ()
+{
+    if (itm == NULL)
+        return false;
+
+    if (itm->scaling == 'z' || (itm->scaling == 'r' && remoteResizeRefused == true))
+        return true;
+
+    if (itm->scaling == 'f' || itm->scaling == 'r')
+        return (fitsScroller() == false);
+
+    return false;
+}
+
+
+/*
+ * ask the host to make its desktop the size of the viewer ('r' scaling
+ * mode), which then needs no scaling at all.  Called (debounced) when the
+ * host is shown or the viewer changes size
+ * (instance method)
+ */
+void VncObject::requestRemoteResize ()
+{
+    if (itm == NULL || itm->scaling != 'r' || remoteResizeRefused == true || vncClient == NULL)
+        return;
+
+#ifndef SV_HAVE_EXT_DESKTOP_SIZE
+    // this libvncclient can't ask, so zoom instead
+    remoteResizeRefused = true;
+    svLogToFile("Resizing the remote desktop needs libvncclient 0.9.14 or newer, scaling"
+        " '" + itm->name + "' instead");
+    setObjectVisible();
+    return;
+#endif
+
+    int nW = app->scroller->w();
+    int nH = app->scroller->h();
+
+    if (nW < 1 || nH < 1)
+        return;
+
+    // already that size, or asked already
+    if ((nW == vncClient->width && nH == vncClient->height)
+        || (nW == remoteResizeW && nH == remoteResizeH))
+        return;
+
+    svDebugLog("requestRemoteResize - Asking '" + itm->name + "' for a new desktop size");
+
+    remoteResizeW = nW;
+    remoteResizeH = nH;
+    remoteResizeTime = svMonotonicMs();
+
+    queueSend(VncSendItem('s', nW, nH));
+}
+
+
+/* see if the host did what requestRemoteResize asked, and zoom if it won't */
+/* (instance method, called every second by svConnectionWatcher) */
+void VncObject::checkRemoteResize ()
+{
+    if (remoteResizeW == 0 || vncClient == NULL || itm == NULL)
+        return;
+
+    if (vncClient->width == remoteResizeW && vncClient->height == remoteResizeH)
+    {
+        remoteResizeW = 0;
+        remoteResizeH = 0;
+        return;
+    }
+
+    if (svMonotonicMs() - remoteResizeTime < SV_REMOTE_RESIZE_TIMEOUT_MS)
+        return;
+
+    // no answer (or not the one we wanted), so stop asking and scale instead
+    remoteResizeW = 0;
+    remoteResizeH = 0;
+    remoteResizeRefused = true;
+
+    svLogToFile("'" + itm->name + "' didn't resize its desktop, scaling it instead");
+
+    if (app->vncViewer->vnc == this)
+        setObjectVisible();
+}
+
+
+/* handle cursor change (decoder thread, the main thread sets it) */
 /* (static method / callback) */
 void VncObject::handleCursorShapeChange (rfbClient * cl, int xHot, int yHot, int nWidth,
     int nHeight, int nBytesPerPixel)
 {
     VncObject * vnc = static_cast<VncObject *>(rfbClientGetClientData(cl, app->libVncVncPointer));
 
-    if (vnc == NULL ||
-        cl == NULL ||
-        Fl::belowmouse() != app->vncViewer ||
-        vnc->allowDrawing == false)
+    if (vnc == NULL || cl == NULL)
         return;
 
-    const int nSSize = nWidth * nHeight * nBytesPerPixel;
+    if ((nBytesPerPixel != 2 && nBytesPerPixel != 4) || nWidth < 1 || nHeight < 1 ||
+        cl->rcSource == NULL || cl->rcMask == NULL)
+        return;
 
-    // if image has alpha, apply mask
-    if (nBytesPerPixel == 2 || nBytesPerPixel == 4)
-    {
-        int nM = 0;
-        int nMV;
+    const rfbPixelFormat& fmt = cl->format;
 
-        for (int i = (nBytesPerPixel - 1); i < nSSize; i += nBytesPerPixel)
-        {
-            nMV = cl->rcMask[nM];
+    if (fmt.redMax == 0 || fmt.greenMax == 0 || fmt.blueMax == 0)
+        return;
 
-            if (nMV > 0)
-                nMV = 255;
+    // build the rgba cursor in one pass, taking alpha from the mask
+    // (the image owns 'buf', so no copy of it is needed)
+    const int nPixels = nWidth * nHeight;
+    unsigned char * buf = new unsigned char[nPixels * 4];
 
-            cl->rcSource[i] = nMV;
+    for (int i = 0; i < nPixels; i ++)
+    {
+        uint32_t nP;
 
-            nM ++;
-        }
+        if (nBytesPerPixel == 4)
+            nP = reinterpret_cast<const uint32_t *>(cl->rcSource)[i];
+        else
+            nP = reinterpret_cast<const uint16_t *>(cl->rcSource)[i];
+
+        buf[i * 4] = ((nP >> fmt.redShift) & fmt.redMax) * 255 / fmt.redMax;
+        buf[i * 4 + 1] = ((nP >> fmt.greenShift) & fmt.greenMax) * 255 / fmt.greenMax;
+        buf[i * 4 + 2] = ((nP >> fmt.blueShift) & fmt.blueMax) * 255 / fmt.blueMax;
+        buf[i * 4 + 3] = (cl->rcMask[i] > 0) ? 255 : 0;
     }
 
-    // create rgb image from raw data
-    Fl_RGB_Image * img = new Fl_RGB_Image(cl->rcSource, nWidth, nHeight, nBytesPerPixel);
+    Fl_RGB_Image * img = new Fl_RGB_Image(buf, nWidth, nHeight, 4);
 
-    if (img == NULL)
-        return;
+    img->alloc_array = 1;
+
+    pthread_mutex_lock(&vnc->bufferMutex);
 
-    // delete previous copy, if any
-    if (vnc->imgCursor != NULL)
-        delete vnc->imgCursor;
+    // replace any cursor the main thread hasn't picked up yet
+    if (vnc->pendingCursor != NULL)
+        delete vnc->pendingCursor;
+
+    vnc->pendingCursor = img;
+    vnc->pendingCursorXHot = xHot;
+    vnc->pendingCursorYHot = yHot;
+
+    pthread_mutex_unlock(&vnc->bufferMutex);
+
+    Fl::awake(VncObject::handleDecoderEvents, NULL);
+}
 
-    // copy rgb image to vncViewer and set x+y hotspots
-    vnc->imgCursor = static_cast<Fl_RGB_Image *>(img->copy());
 
-    if (vnc->imgCursor == NULL)
+/* add a rectangle to a damage list, merging it with any rectangles it touches */
+/* (static method) */
+void VncObject::addDamageRect (std::vector<VncRect>& rects, VncRect r)
+{
+    if (r.w < 1 || r.h < 1)
         return;
 
-    vnc->nCursorXHot = xHot;
-    vnc->nCursorYHot = yHot;
+    bool merged = true;
+
+    // keep merging until the new rectangle doesn't touch any in the list
+    while (merged == true)
+    {
+        merged = false;
+
+        for (size_t i = 0; i < rects.size(); i ++)
+        {
+            const VncRect& o = rects[i];
+
+            if (r.x <= o.x + o.w && o.x <= r.x + r.w
+                && r.y <= o.y + o.h && o.y <= r.y + r.h)
+            {
+                int nX2 = std::max(r.x + r.w, o.x + o.w);
+                int nY2 = std::max(r.y + r.h, o.y + o.h);
+
+                r.x = std::min(r.x, o.x);
+                r.y = std::min(r.y, o.y);
+                r.w = nX2 - r.x;
+                r.h = nY2 - r.y;
+
+                rects.erase(rects.begin() + i);
+                merged = true;
+                break;
+            }
+        }
+    }
+
+    rects.push_back(r);
+
+    // lots of tiny rectangles cost more in draw calls than they
+    // save, so collapse them into their bounding box
+    if (rects.size() > SV_MAX_DAMAGE_RECTS)
+    {
+        VncRect bounds = rects[0];
+
+        for (size_t i = 1; i < rects.size(); i ++)
+        {
+            int nX2 = std::max(bounds.x + bounds.w, rects[i].x + rects[i].w);
+            int nY2 = std::max(bounds.y + bounds.h, rects[i].y + rects[i].h);
 
-    svHandleThreadCursorChange(NULL);
+            bounds.x = std::min(bounds.x, rects[i].x);
+            bounds.y = std::min(bounds.y, rects[i].y);
+            bounds.w = nX2 - bounds.x;
+            bounds.h = nY2 - bounds.y;
+        }
 
-    delete img;
+        rects.clear();
+        rects.push_back(bounds);
+    }
 }
 
 
-/* (static method) */
-void VncObject::handleFrameBufferUpdate (rfbClient * cl) //, int x, int y, int w, int h)
+/* collect changed rectangles as libvnc decodes them */
+/* (static method / callback) */
+void VncObject::handleGotFrameBufferUpdate (rfbClient * cl, int x, int y, int w, int h)
 {
     VncObject * vnc = static_cast<VncObject *>(rfbClientGetClientData(cl, app->libVncVncPointer));
 
-    if (vnc == NULL || vnc->allowDrawing == false)
+    if (vnc == NULL)
         return;
 
-    app->vncViewer->redraw();
+    // (only the decoder thread touches damageRects, so no lock is needed)
+    VncObject::addDamageRect(vnc->damageRects, VncRect(x, y, w, h));
+
+    vnc->adaptPixels += static_cast<long>(w) * h;
+    vnc->updatePixels += static_cast<long>(w) * h;
 }
 
 
-/* handle copy/cut FROM vnc host */
-/* (static method) */
-void VncObject::handleRemoteClipboardProc (rfbClient * cl, const char * text, int textlen)
+/*
+ * publish a finished update.  The decoded back buffer becomes the front
+ * buffer the viewer draws from, then the damaged rectangles are copied back
+ * so the new back buffer is current again (libvnc reads it for copyrect and
+ * friends).  The main thread is woken to redraw if the viewer is showing
+ * (static method / callback)
+ */
+void VncObject::handleFrameBufferUpdate (rfbClient * cl)
 {
     VncObject * vnc = static_cast<VncObject *>(rfbClientGetClientData(cl, app->libVncVncPointer));
 
     if (vnc == NULL)
         return;
 
-    VncObject * vnc2 = app->vncViewer->vnc;
+    // time from asking for this update to having it decoded, for the quality
+    // controller.  The host answers a full request straight away, so that
+    // measures the round trip too.  An incremental one waits until something
+    // changes, so the last measured round trip stands in for the wait
+    long nNow = svMonotonicMs();
+
+    if (vnc->fullRequestMs != 0 && vnc->messageStartMs >= vnc->fullRequestMs)
+    {
+        vnc->adaptRttMs = vnc->messageStartMs - vnc->fullRequestMs;
+        vnc->adaptFrameMs += nNow - vnc->fullRequestMs;
+    }
+    else
+        vnc->adaptFrameMs += vnc->adaptRttMs + nNow - vnc->messageStartMs;
+
+    vnc->adaptFrames ++;
+    vnc->adaptCpuMs += svThreadCpuMs() - vnc->messageStartCpuMs;
+
+    // (libvnc has just sent the incremental request for the next one)
+    vnc->fullRequestMs = 0;
+
+    // (both can send to the host)
+    pthread_mutex_lock(&vnc->writeMutex);
+
+    // a benchmark is timing updates that started after its request
+    if (vnc->benchEncoding != "" && vnc->messageStartMs >= vnc->benchRequestMs)
+    {
+        vnc->benchPixels += vnc->updatePixels;
+
+        if (vnc->benchPixels >= static_cast<long>(cl->width) * cl->height)
+        {
+            long nMs = svMonotonicMs() - vnc->benchRequestMs;
+            char strLine[128] = {};
+
+            snprintf(strLine, sizeof(strLine), "%s: %li ms\n", vnc->benchEncoding.c_str(), nMs);
+            vnc->benchReport += strLine;
 
-    if (vnc2 == NULL)
+            if (vnc->benchBest == "" || nMs < vnc->benchBestMs)
+            {
+                vnc->benchBest = vnc->benchEncoding;
+                vnc->benchBestMs = nMs;
+            }
+
+            vnc->benchmarkNext();
+        }
+    }
+
+    vnc->updatePixels = 0;
+
+    vnc->adaptEncodings();
+
+    pthread_mutex_unlock(&vnc->writeMutex);
+
+    if (vnc->damageRects.empty() == true)
         return;
 
-    if (vnc2 == vnc && text != NULL && textlen > 0)
+    bool needsWake = false;
+
+    pthread_mutex_lock(&vnc->bufferMutex);
+
+    if (vnc->frontBuffer != NULL && cl->frameBuffer != NULL)
     {
-        app->blockLocalClipboardHandling = true;
+        std::swap(vnc->frontBuffer, cl->frameBuffer);
+        std::swap(vnc->shmFront, vnc->shmBack);
+
+        const int nBpp = cl->format.bitsPerPixel / 8;
+        const size_t nStride = static_cast<size_t>(vnc->bufferW) * nBpp;
 
-        Fl::copy(text, textlen, 1);
+        for (size_t i = 0; i < vnc->damageRects.size(); i ++)
+        {
+            const VncRect& r = vnc->damageRects[i];
+            const int nX = std::max(r.x, 0);
+            const int nY = std::max(r.y, 0);
+            const int nX2 = std::min(r.x + r.w, vnc->bufferW);
+            const int nY2 = std::min(r.y + r.h, vnc->bufferH);
+
+            if (nX2 <= nX || nY2 <= nY)
+                continue;
+
+            for (int y = nY; y < nY2; y ++)
+            {
+                size_t nOffset = y * nStride + nX * nBpp;
+                memcpy(cl->frameBuffer + nOffset, vnc->frontBuffer + nOffset, (nX2 - nX) * nBpp);
+            }
 
-        SendFramebufferUpdateRequest(cl, 0, 0, cl->width, cl->height, false);
+            if (vnc->allowDrawing == true)
+                VncObject::addDamageRect(vnc->drawRects, r);
+        }
 
-        app->blockLocalClipboardHandling = false;
+        if (vnc->allowDrawing == true)
+            vnc->framesDecoded ++;
 
-        app->vncViewer->redraw();
-        Fl::awake();
+        if (vnc->allowDrawing == true && vnc->redrawPending == false)
+        {
+            vnc->redrawPending = true;
+            needsWake = true;
+        }
     }
+
+    pthread_mutex_unlock(&vnc->bufferMutex);
+
+    vnc->damageRects.clear();
+
+    if (needsWake == true)
+        Fl::awake(VncObject::handleDecoderEvents, NULL);
+}
+
+
+/* handle copy/cut FROM vnc host (decoder thread, the main thread copies it) */
+/* (static method) */
+void VncObject::handleRemoteClipboardProc (rfbClient * cl, const char * text, int textlen)
+{
+    VncObject * vnc = static_cast<VncObject *>(rfbClientGetClientData(cl, app->libVncVncPointer));
+
+    if (vnc == NULL || text == NULL || textlen < 1)
+        return;
+
+    pthread_mutex_lock(&vnc->bufferMutex);
+
+    vnc->pendingClipboard.assign(text, textlen);
+    vnc->hasPendingClipboard = true;
+
+    pthread_mutex_unlock(&vnc->bufferMutex);
+
+    Fl::awake(VncObject::handleDecoderEvents, NULL);
 }
 
 
@@ -509,6 +870,9 @@ void VncObject::hideMainViewer ()
 
     vnc->allowDrawing = false;
 
+    // nobody's looking, so make updates cheap
+    vnc->setLowCostProfile(true);
+
     app->mainWin->cursor(FL_CURSOR_DEFAULT);
 
     Fl::lock();
@@ -528,86 +892,73 @@ void * VncObject::initVNCConnection (void * data)
     // detach this thread
     pthread_detach(pthread_self());
 
-    char * strParams[2] = {NULL, NULL};
-
-    Fl::lock();
-    HostItem * itm = static_cast<HostItem *>(data);
-    Fl::unlock();
-
-    if (itm == NULL)
-    {
-        Fl::awake(svHandleThreadConnection, itm);
+    // (our own pointer to the viewer - itm->vnc is cleared if the viewer is
+    // ended while we're still connecting)
+    VncObject * vnc = static_cast<VncObject *>(data);
 
+    if (vnc == NULL || vnc->itm == NULL)
         return SV_RET_VOID;
-    }
 
-    itm->threadRFBRunning = true;
+    HostItem * itm = vnc->itm;
 
-    int nNumOfParams = 2;
-    VncObject * vnc = itm->vnc;
+    rfbClient * cl = vnc->vncClient;
+    rfbBool connected;
+
+    // ssh hosts are already connected to their tunnel, listeners wait for
+    // the host to call and everything else connects here
+    if (itm->hostType == 's' && itm->isListener == false)
+        connected = TRUE;
+    else if (itm->isListener == true)
+        connected = vnc->listenForHost();
+    else
+        connected = vnc->connectToHost();
 
-    if (vnc == NULL)
+    // libvnc - the rfb handshake
+    // (endViewer shuts the socket down to get us out of this early, and
+    // svConnectionWatcher ends the viewer if it takes too long)
+    if (connected == TRUE)
     {
-        itm->isConnected = false;
-        itm->isConnecting = false;
-        itm->hasError = true;
-        itm->threadRFBRunning = false;
+        vnc->setConnectState(SV_CONN_RFB_INIT);
+        connected = VncObject::initConnectedClient(cl, itm);
+    }
 
-        Fl::awake(svHandleThreadConnection, itm);
+    int nError = errno;
 
-        return SV_RET_VOID;
-    }
+    pthread_mutex_lock(&vnc->bufferMutex);
 
-    std::string strP;
+    vnc->connectRunning = false;
 
-    // 'program name' parameter
-    strParams[0] = strdup("SpiritVNCFLTK");
+    bool stopped = vnc->stopConnect;
+    bool ownsClient = vnc->connectOwnsClient;
 
-    if (itm->isListener == false)
+    if (stopped == false)
     {
-        strP = itm->vncAddressAndPort;
-        strParams[1] = strdup(strP.c_str());
-    }
-    else
-    {
-        strP = "-listennofork";
-        vnc->vncClient->listenAddress = strdup("0.0.0.0");
-        strParams[1] = strdup(strP.c_str());
+        itm->isConnected = (connected == TRUE);
+        itm->isConnecting = false;
+        itm->isWaitingForShow = (connected == TRUE);
+        itm->hasCouldntConnect = (connected == FALSE);
     }
 
-    // if the second parameter is invalid, get out
-    if (strParams[1] == NULL || strlen(strParams[1]) < 7)
+    pthread_mutex_unlock(&vnc->bufferMutex);
+
+    // the viewer was ended while we were connecting and left the rest to us
+    // (itm may well be on to a new connection by now, so it's left alone)
+    if (ownsClient == true)
     {
-        itm->isConnected = false;
-        itm->isConnecting = false;
-        itm->hasError = true;
-        itm->threadRFBRunning = false;
+        rfbClientCleanup(cl);
+        vnc->closeConnectWake();
 
-        Fl::awake(svHandleThreadConnection, itm);
+        delete vnc;
 
         return SV_RET_VOID;
     }
 
-    // libvnc - attempt to connect to host
-    // this function blocks, that's why this function runs as a thread
-    if (rfbInitClient(vnc->vncClient, &nNumOfParams, strParams) == false)
-    {
-        VncObject::parseErrorMessages(itm, strerror(errno));
-
-        itm->isConnected = false;
-        itm->isConnecting = false;
-        itm->hasCouldntConnect = true;
-        itm->threadRFBRunning = false;
-
-        Fl::awake(svHandleThreadConnection, itm);
-
+    // (endAndDeleteViewer is still finishing up and will clean up itself)
+    if (stopped == true)
         return SV_RET_VOID;
-    }
 
-    itm->isConnected = true;
-    itm->isConnecting = false;
-    itm->isWaitingForShow = true;
-    itm->threadRFBRunning = false;
+    if (connected == FALSE)
+        VncObject::parseErrorMessages(itm, strerror(nError));
 
     // send message to main thread
     Fl::awake(svHandleThreadConnection, itm);
@@ -616,12 +967,282 @@ void * VncObject::initVNCConnection (void * data)
 }
 
 
-/* check connection errors and inform user, if necessary */
-void VncObject::parseErrorMessages (HostItem * itm, const char * strMessageIn)
+/*
+ * the rest of what rfbInitClient does, for a client whose socket is
+ * already connected.  Unlike rfbInitClient, this leaves cleaning up the
+ * client on failure to endViewer
+ * (static method)
+ */
+rfbBool VncObject::initConnectedClient (rfbClient * cl, HostItem * itm)
 {
-    char strMsg[FL_PATH_MAX] = {0};
-
-    if (itm == NULL || strMessageIn == NULL)
+    // (libvnc only uses these for messages)
+    if (itm->isListener == false)
+    {
+        free(cl->serverHost);
+        cl->serverHost = strdup(itm->hostAddress.c_str());
+        cl->serverPort = atoi(itm->vncPort.c_str());
+    }
+
+    bool initialized = (InitialiseRFBConnection(cl) == TRUE);
+
+    if (initialized == true)
+    {
+        cl->width = cl->si.framebufferWidth;
+        cl->height = cl->si.framebufferHeight;
+
+        initialized = (cl->MallocFrameBuffer(cl) == TRUE && SetFormatAndEncodings(cl) == TRUE);
+    }
+
+    if (initialized == true)
+    {
+        if (cl->updateRect.x < 0)
+        {
+            cl->updateRect.x = 0;
+            cl->updateRect.y = 0;
+            cl->updateRect.w = cl->width;
+            cl->updateRect.h = cl->height;
+        }
+
+        initialized = (SendFramebufferUpdateRequest(cl, cl->updateRect.x, cl->updateRect.y,
+            cl->updateRect.w, cl->updateRect.h, FALSE) == TRUE);
+    }
+
+    return (initialized == true ? TRUE : FALSE);
+}
+
+
+/*
+ * move the host on to its next connection state, unless endViewer has
+ * stopped this connection (the host may be on to a new one)
+ * (connection thread)
+ * (instance method)
+ */
+void VncObject::setConnectState (int nState)
+{
+    pthread_mutex_lock(&bufferMutex);
+
+    if (stopConnect == false)
+        svSetConnectState(itm, nState);
+
+    pthread_mutex_unlock(&bufferMutex);
+}
+
+
+/*
+ * open a tcp connection to this viewer's host without blocking, giving up
+ * after app->nConnectionTimeout seconds or as soon as endViewer says to.
+ * On failure, errno says why
+ * (connection thread)
+ * (instance method)
+ */
+rfbBool VncObject::connectToHost ()
+{
+    struct addrinfo hints;
+    struct addrinfo * addrs = NULL;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    char strPort[16] = {0};
+    snprintf(strPort, sizeof(strPort), "%i", svVncPortNumber(itm->vncPort));
+
+    // (the name lookup itself can't be woken, but it has its own timeouts)
+    if (getaddrinfo(itm->hostAddress.c_str(), strPort, &hints, &addrs) != 0 || addrs == NULL)
+    {
+        errno = EHOSTUNREACH;
+        return FALSE;
+    }
+
+    long nDeadline = svMonotonicMs() + (app->nConnectionTimeout * 1000L);
+    int nError = ETIMEDOUT;
+    int sock = -1;
+
+    for (struct addrinfo * addr = addrs; addr != NULL && sock == -1; addr = addr->ai_next)
+    {
+        if (stopConnect == true)
+        {
+            nError = ECANCELED;
+            break;
+        }
+
+        int sockTry = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+
+        if (sockTry < 0)
+        {
+            nError = errno;
+            continue;
+        }
+
+        fcntl(sockTry, F_SETFL, fcntl(sockTry, F_GETFL, 0) | O_NONBLOCK);
+
+        if (connect(sockTry, addr->ai_addr, addr->ai_addrlen) != 0 && errno != EINPROGRESS)
+        {
+            nError = errno;
+            close(sockTry);
+            continue;
+        }
+
+        // wait for the connection or a wake from endViewer, whichever is first
+        struct pollfd fds[2];
+        int nReady = 0;
+
+        fds[0].fd = sockTry;
+        fds[0].events = POLLOUT;
+        fds[1].fd = connectWakePipe[0];
+        fds[1].events = POLLIN;
+
+        while (stopConnect == false)
+        {
+            long nWait = nDeadline - svMonotonicMs();
+
+            if (nWait <= 0)
+                break;
+
+            nReady = poll(fds, 2, static_cast<int>(nWait));
+
+            if (nReady >= 0 || errno != EINTR)
+                break;
+        }
+
+        int nSockError = 0;
+        socklen_t nLen = sizeof(nSockError);
+
+        if (stopConnect == true)
+            nError = ECANCELED;
+        else if (nReady > 0 && fds[0].revents != 0
+            && getsockopt(sockTry, SOL_SOCKET, SO_ERROR, &nSockError, &nLen) == 0
+            && nSockError == 0)
+            sock = sockTry;
+        else if (nSockError != 0)
+            nError = nSockError;
+        else
+            nError = ETIMEDOUT;
+
+        if (sock == -1)
+            close(sockTry);
+
+        // the next address gets whatever time is left
+        if (svMonotonicMs() >= nDeadline)
+            break;
+    }
+
+    freeaddrinfo(addrs);
+
+    if (sock == -1)
+    {
+        errno = nError;
+        return FALSE;
+    }
+
+    // (libvnc does this for the connections it makes)
+    int nOne = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &nOne, sizeof(nOne));
+
+    // hand it over, unless endViewer is already looking for it
+    pthread_mutex_lock(&bufferMutex);
+
+    bool stopped = stopConnect;
+
+    if (stopped == false)
+        vncClient->sock = sock;
+
+    pthread_mutex_unlock(&bufferMutex);
+
+    if (stopped == true)
+    {
+        close(sock);
+        errno = ECANCELED;
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+
+/*
+ * wait for a host to reverse-connect to this listening viewer, checking
+ * every so often whether endViewer wants it to give up
+ * (connection thread)
+ * (instance method)
+ */
+rfbBool VncObject::listenForHost ()
+{
+    if (vncClient->listenAddress == NULL)
+        vncClient->listenAddress = strdup("0.0.0.0");
+
+    while (stopConnect == false)
+    {
+        int nResult = listenForIncomingConnectionsNoFork(vncClient, SV_LISTEN_POLL_USECS);
+
+        if (nResult < 0)
+            return FALSE;
+
+        if (nResult == 0)
+            continue;
+
+        // (libvnc has handed the client the socket, so endViewer can shut it down)
+        pthread_mutex_lock(&bufferMutex);
+        bool stopped = stopConnect;
+        pthread_mutex_unlock(&bufferMutex);
+
+        if (stopped == false)
+            return TRUE;
+    }
+
+    errno = ECANCELED;
+
+    return FALSE;
+}
+
+
+/*
+ * tell this viewer's connection thread to give up, waking it from its
+ * connect or handshake
+ * (instance method)
+ */
+void VncObject::stopConnectThread ()
+{
+    // (the thread can't finish while we hold this, so it's safe to wake)
+    pthread_mutex_lock(&bufferMutex);
+
+    if (connectRunning == true)
+    {
+        stopConnect = true;
+
+        if (connectWakePipe[1] != -1 && write(connectWakePipe[1], "x", 1) < 0)
+            svDebugLog("stopConnectThread - Could not write to the wake pipe");
+
+        // unblocks a handshake read or write
+        if (vncClient != NULL && vncClient->sock >= 0)
+            shutdown(vncClient->sock, SHUT_RDWR);
+    }
+
+    pthread_mutex_unlock(&bufferMutex);
+}
+
+
+/* close the connection thread's wake pipe */
+/* (instance method) */
+void VncObject::closeConnectWake ()
+{
+    if (connectWakePipe[0] != -1)
+        close(connectWakePipe[0]);
+
+    if (connectWakePipe[1] != -1)
+        close(connectWakePipe[1]);
+
+    connectWakePipe[0] = -1;
+    connectWakePipe[1] = -1;
+}
+
+
+/* check connection errors and inform user, if necessary */
+void VncObject::parseErrorMessages (HostItem * itm, const char * strMessageIn)
+{
+    char strMsg[FL_PATH_MAX] = {0};
+
+    if (itm == NULL || strMessageIn == NULL)
       return;
 
     // formate for log file
@@ -665,62 +1286,201 @@ void VncObject::libVncLogging (const char * format, ...)
 }
 
 
-/* master loop to handle all vnc objects' message checking */
-/* (static function) */
+/*
+ * main program loop.  Each connected host's server messages are handled
+ * by its own decoder thread (see decoderThread), which wakes this loop
+ * through Fl::awake when there's something for the main thread to do
+ * (static method)
+ */
 void VncObject::masterMessageLoop ()
 {
-    HostItem * itm = NULL;
-    VncObject * vnc = NULL;
-
     while (app->shuttingDown == false)
+        Fl::wait(0.250);
+}
+
+
+/*
+ * libvnc framebuffer allocation callback (connect and remote resize).
+ * Buffers are allocated on the main thread because shared memory images
+ * belong to the x connection, so the decoder thread asks for them and waits
+ * (static function)
+ */
+rfbBool VncObject::handleMallocFrameBuffer (rfbClient * cl)
+{
+    VncObject * vnc = static_cast<VncObject *>(rfbClientGetClientData(cl, app->libVncVncPointer));
+
+    if (vnc == NULL || cl->width < 1 || cl->height < 1)
+        return FALSE;
+
+    // while connecting this runs on the connection thread, so just take the lock
+    if (vnc->decoderRunning == false || pthread_equal(pthread_self(), vnc->threadDecoder) == 0)
     {
-        // only loop if there are objects alive
-        if (app->createdObjects != 0)
-        {
-            // spend the most time processing the active vnc connection
-            for (unsigned int i = 0; i < 100; i++)
-            {
-                // keep from making too tight a loop
-                Fl::wait(0.100);
+        Fl::lock();
+        // (endViewer has already freed the buffers, if it's told us to stop)
+        rfbBool result = (vnc->stopConnect == true ? FALSE : vnc->allocFrameBuffer());
+        Fl::unlock();
 
-                vnc = app->vncViewer->vnc;
+        return result;
+    }
 
-                if (vnc != NULL && vnc->itm != NULL)
-                    VncObject::checkVNCMessages(vnc);
-                else
-                    break;
-            }
+    bool wasNative = vnc->nativeFormat;
 
-            // after current connection looping 100 times,
-            // iterate through the host list one time and
-            // check each to see if the connection is alive
-            for (int i = 0; i <= app->hostList->size(); i ++)
-            {
-                Fl::lock();
-                itm = static_cast<HostItem *>(app->hostList->data(i));
-                Fl::unlock();
+    // remote resize on the decoder thread, so have the main thread do it
+    pthread_mutex_lock(&vnc->bufferMutex);
 
-                if (itm == NULL)
-                    continue;
+    vnc->mallocRequested = true;
+    vnc->mallocDone = false;
 
-                vnc = itm->vnc;
+    Fl::awake(VncObject::handleDecoderEvents, NULL);
 
-                if (vnc == NULL)
-                    continue;
+    while (vnc->mallocDone == false && vnc->stopDecoder == false)
+        pthread_cond_wait(&vnc->mallocCond, &vnc->bufferMutex);
 
-                // if this vnc object is connected and is active, process vnc messages
-                if (itm->isConnected == true
-                    && itm->hasEnded == false
-                    && app->shuttingDown == false)
-                        VncObject::checkVNCMessages(vnc);
+    rfbBool result = (vnc->mallocDone == true ? vnc->mallocResult : FALSE);
 
-                itm = NULL;
-                vnc = NULL;
-            }
+    vnc->mallocRequested = false;
+
+    pthread_mutex_unlock(&vnc->bufferMutex);
+
+    // a remote resize keeps the old pixel format unless we send the new one
+    // (while connecting, libvnc sends it right after this)
+    if (result == TRUE && wasNative != vnc->nativeFormat)
+    {
+        pthread_mutex_lock(&vnc->writeMutex);
+        SetFormatAndEncodings(cl);
+        SendFramebufferUpdateRequest(cl, 0, 0, cl->width, cl->height, FALSE);
+        pthread_mutex_unlock(&vnc->writeMutex);
+
+        vnc->fullRequestMs = svMonotonicMs();
+    }
+
+    return result;
+}
+
+
+/*
+ * allocate the front and back framebuffers at the client's current size.
+ * With the host's native pixel format option on X11, pixels come in the
+ * display's own layout and, when possible, straight into shared memory
+ * images, so drawing needs no conversion.  Otherwise they're plain rgb
+ * buffers, as libvnc would allocate.  Must be called with the fltk lock held
+ * (instance method)
+ */
+rfbBool VncObject::allocFrameBuffer ()
+{
+    rfbClient * cl = vncClient;
+
+    if (cl == NULL || itm == NULL)
+        return FALSE;
+
+    pthread_mutex_lock(&bufferMutex);
+
+    freeFrameBuffer();
+    freeScaledBuffer();
+
+    // old damage refers to the old buffers
+    damageRects.clear();
+    drawRects.clear();
+    presentRects.clear();
+
+    SVPixelFormat fmt;
+
+    // remember libvnc's rgb format so we can go back to it
+    if (nativeFormat == false)
+        rgbFormat = cl->format;
+
+    // have the server send pixels laid out the way the display stores them
+    // (if the host wants that and the visual allows it), else the rgb fltk draws
+    nativeFormat = (itm->nativePixelFormat == true && svNativePixelFormat(fmt) == true);
+
+    if (nativeFormat == true)
+    {
+        cl->format.bitsPerPixel = fmt.bitsPerPixel;
+        cl->format.depth = fmt.depth;
+        cl->format.trueColour = TRUE;
+        cl->format.bigEndian = (fmt.bigEndian == true ? TRUE : FALSE);
+        cl->format.redMax = fmt.redMax;
+        cl->format.greenMax = fmt.greenMax;
+        cl->format.blueMax = fmt.blueMax;
+        cl->format.redShift = fmt.redShift;
+        cl->format.greenShift = fmt.greenShift;
+        cl->format.blueShift = fmt.blueShift;
+    }
+    else
+        cl->format = rgbFormat;
+
+    // native pixels can live in x shared memory and go to the window untouched
+    // (both buffers or neither, so a swap never mixes the two kinds)
+    if (nativeFormat == true && app->useXShm == true)
+    {
+        shmFront = svShmCreate(cl->width, cl->height);
+        shmBack = svShmCreate(cl->width, cl->height);
+
+        if (shmFront != NULL && shmBack != NULL)
+        {
+            frontBuffer = shmFront->data;
+            cl->frameBuffer = shmBack->data;
         }
+        else
+            freeFrameBuffer();
+    }
 
-        Fl::wait(0.250);
+    if (shmFront == NULL)
+    {
+        size_t nSize = static_cast<size_t>(cl->width) * cl->height * (cl->format.bitsPerPixel / 8);
+
+        frontBuffer = static_cast<unsigned char *>(calloc(nSize, 1));
+        cl->frameBuffer = static_cast<uint8_t *>(calloc(nSize, 1));
+
+        if (frontBuffer == NULL || cl->frameBuffer == NULL)
+        {
+            freeFrameBuffer();
+            pthread_mutex_unlock(&bufferMutex);
+            svLogToFile("ERROR - Could not allocate the framebuffer for '" + itm->name + "'");
+            return FALSE;
+        }
+    }
+
+    bufferW = cl->width;
+    bufferH = cl->height;
+
+    // libvnc goes back to asking for the whole screen after a resize
+    requestRect = VncRect(0, 0, bufferW, bufferH);
+
+    pthread_mutex_unlock(&bufferMutex);
+
+    svDebugLog(std::string("allocFrameBuffer - Using ") +
+        (shmFront != NULL ? "shared memory" : "heap") + " framebuffers, " +
+        (nativeFormat == true ? "native" : "rgb") + " pixel format");
+
+    return TRUE;
+}
+
+
+/* release the framebuffers, whichever way they were allocated */
+/* (instance method) */
+void VncObject::freeFrameBuffer ()
+{
+    if (vncClient == NULL)
+        return;
+
+    if (shmFront != NULL || shmBack != NULL)
+    {
+        svShmDestroy(shmFront);
+        svShmDestroy(shmBack);
+        shmFront = NULL;
+        shmBack = NULL;
+    }
+    else
+    {
+        free(frontBuffer);
+        free(vncClient->frameBuffer);
     }
+
+    frontBuffer = NULL;
+    vncClient->frameBuffer = NULL;
+    bufferW = 0;
+    bufferH = 0;
 }
 
 
@@ -763,19 +1523,30 @@ void VncObject::setObjectVisible ()
 
     app->vncViewer->vnc = this;
 
-    SendFramebufferUpdateRequest(vncClient, 0, 0, vncClient->width, vncClient->height, false);
+    // back to full quality before asking for the visible screen below
+    setLowCostProfile(false);
+
+    // whole viewer gets drawn below, so forget any stale damage
+    pthread_mutex_lock(&bufferMutex);
+    drawRects.clear();
+    pthread_mutex_unlock(&bufferMutex);
+
+    presentRects.clear();
+
+    // updates weren't tracked while hidden, so rebuild the scaled image
+    scaledValid = false;
 
     int leftMargin = (app->hostList->x() + app->hostList->w() + 3);
 
     // scale off / scroll if host screen is too big
-    if (itm->scaling == 's' || (itm->scaling == 'f' && fitsScroller() == true))
+    if (isScaled() == false)
     {
         app->scroller->type(Fl_Scroll::BOTH);
         app->vncViewer->size(vncClient->width, vncClient->height);
     }
 
     // scale 'zoom' or 'fit'
-    if (itm->scaling == 'z' || (itm->scaling == 'f' && fitsScroller() == false))
+    if (isScaled() == true)
     {
         // maximize vnc viewer size
         app->vncViewer->size(
@@ -800,7 +1571,7 @@ void VncObject::setObjectVisible ()
     svResizeScroller();
 
     // viewer centering (only if not zooming)
-    if (itm->scaling == 's' || (itm->scaling == 'f' && fitsScroller() == true))
+    if (isScaled() == false)
     {
         // figure out x position for viewer
         if (itm->centerX == true)
@@ -828,127 +1599,1327 @@ void VncObject::setObjectVisible ()
 
     allowDrawing = true;
 
-    app->scroller->redraw();
-}
-
-
-/* check and act on libvnc host messages */
-/* (static method) */
-void VncObject::checkVNCMessages (VncObject * vnc)
-{
-    int nMsg = 0;
-
-    if (vnc == NULL || vnc->vncClient == NULL)
-        return;
-
-    // below modified to '0' based on select() docs suggestion
-    nMsg = WaitForMessage(vnc->vncClient, 0);
+    // ask for all of whatever part of the screen is showing now
+    updateViewport(true);
 
-    if (nMsg < 0)
+    // have an 'r'esize host match the viewer once the viewer settles down
+    if (itm->scaling == 'r' && remoteResizeRefused == false)
     {
-        VncObject::endAndDeleteViewer(&vnc);
-        return;
+        Fl::remove_timeout(svRemoteResizeTimer);
+        Fl::add_timeout(SV_REMOTE_RESIZE_DELAY, svRemoteResizeTimer);
     }
 
-    if (nMsg)
-    {
-        // reset inactive seconds so we don't automatically disconnect
-        vnc->inactiveSeconds = 0;
+    // a background host may be sitting out its interval, so get it going
+    wakeDecoder();
 
-        if (HandleRFBServerMessage(vnc->vncClient) == FALSE)
-        {
-            VncObject::endAndDeleteViewer(&vnc);
-            return;
-        }
-        else
-            Fl::awake();
-    }
+    app->scroller->redraw();
 }
 
 
 /*
- * ########################################################################################
- * ########################## VNC VIEWER WIDGET ###########################################
- * ########################################################################################
+ * per-connection decoder thread.  Waits on the host's socket (and the wake
+ * pipe, for queued sends and shutdown), decodes every server message that's
+ * waiting into the back buffer and sends what's queued for the host (only
+ * input that can go straight out is written by the main thread, see
+ * sendNow).  It never takes the fltk lock; results go to the main thread
+ * through handleDecoderEvents.
+ *
+ * The host being viewed is serviced as soon as data arrives.  Other hosts
+ * are serviced at most every app->nBackgroundInterval ms, but always within
+ * it, so they neither eat cpu nor build up a backlog (libvnc only asks for
+ * the next update after handling one, so the host merges changes meanwhile)
+ * (static method / thread)
  */
-/* draw event for vnc view widget */
-/* (instance method) */
-void VncViewer::draw ()
+void * VncObject::decoderThread (void * data)
 {
-    VncObject * vnc = app->vncViewer->vnc;
+    VncObject * vnc = static_cast<VncObject *>(data);
 
-    if (vnc == NULL ||
-        vnc->allowDrawing == false ||
-        vnc->vncClient == NULL)
-        return;
+    if (vnc == NULL || vnc->vncClient == NULL)
+        return SV_RET_VOID;
 
     rfbClient * cl = vnc->vncClient;
-    HostItem * itm = static_cast<HostItem *>(vnc->itm);
+    long nPendingSince = 0;
 
-    if (cl == NULL || itm == NULL || cl->frameBuffer == NULL)
-        return;
+    while (vnc->stopDecoder == false)
+    {
+        vnc->flushSendQueue();
 
-    int nBytesPerPixel = cl->format.bitsPerPixel / 8;
+        pthread_mutex_lock(&vnc->writeMutex);
+        vnc->checkBenchmark();
+        pthread_mutex_unlock(&vnc->writeMutex);
 
-    // get out if client or scroller size is wrong
-    if (cl->width < 1 || cl->height < 1 || app->scroller->w() < 1 || app->scroller->h() < 1)
-        return;
+        // anything libvnc already read into its buffer won't wake poll
+        if (cl->buffered == 0)
+        {
+            struct pollfd fds[2];
 
-    // 's'croll or 'f'it + real size scale mode geometry
-    if (itm->scaling == 's' || (itm->scaling == 'f' && vnc->fitsScroller() == true))
-    {
-        // draw that vnc host!
-        fl_draw_image(
-            cl->frameBuffer,
-            app->scroller->x() - app->scroller->xposition(),
-            app->scroller->y() - app->scroller->yposition(),
-            cl->width,
-            cl->height,
-            nBytesPerPixel,
-            0);
+            fds[0].fd = cl->sock;
+            fds[0].events = POLLIN;
+            fds[0].revents = 0;
+            fds[1].fd = vnc->wakePipe[0];
+            fds[1].events = POLLIN;
+            fds[1].revents = 0;
 
-        return;
-    }
+            int nReady = poll(fds, 2, 1000);
 
-    // 'z'oom or 'f'it + oversized scale mode geometry
-    if (itm->scaling == 'z' || (itm->scaling == 'f' && vnc->fitsScroller() == false))
-    {
-        Fl_Image * imgC = NULL;
-        Fl_RGB_Image * imgZ = NULL;
+            if (nReady < 0 && errno == EINTR)
+                continue;
 
-        int isize = cl->width * cl->height * nBytesPerPixel;
+            if (nReady < 0)
+                break;
 
-        // if there's an alpha byte, set it to 255
-        if (nBytesPerPixel == 2 || nBytesPerPixel == 4)
-        {
-            for (int i = (nBytesPerPixel - 1); i < isize; i+= nBytesPerPixel)
-                cl->frameBuffer[i] = 255;
+            // drain the wake pipe
+            if ((fds[1].revents & POLLIN) != 0)
+            {
+                char buf[64];
+
+                while (read(vnc->wakePipe[0], buf, sizeof(buf)) > 0)
+                    ;
+            }
+
+            if (vnc->stopDecoder == true)
+                break;
+
+            if ((fds[0].revents & (POLLIN | POLLHUP | POLLERR)) == 0)
+                continue;
         }
 
-        imgZ = new Fl_RGB_Image(cl->frameBuffer, cl->width, cl->height, nBytesPerPixel);
+        // how much is waiting and for how long it waited
+        int nUnread = 0;
 
-        if (imgZ != NULL)
-        {
-            // set appropriate scale quality
-            if (itm->scalingFast == true)
-                imgZ->RGB_scaling(FL_RGB_SCALING_NEAREST);
-            else
-                imgZ->RGB_scaling(FL_RGB_SCALING_BILINEAR);
+        if (ioctl(cl->sock, FIONREAD, &nUnread) < 0)
+            nUnread = 0;
 
-            // scale down imgZ image to imgC
-            imgC = imgZ->copy(app->vncViewer->w(), app->vncViewer->h());
+        vnc->queuedBytes = nUnread + cl->buffered;
+        vnc->queuedBytesMax = std::max(vnc->queuedBytesMax, vnc->queuedBytes);
 
-            // draw scaled image onto screen
-            if (imgC != NULL)
-                imgC->draw(app->vncViewer->x(), app->vncViewer->y());
-        }
+        if (nPendingSince != 0)
+            vnc->serviceWaitMax = std::max(vnc->serviceWaitMax, svMonotonicMs() - nPendingSince);
 
-        if (imgC != NULL)
-            delete imgC;
+        nPendingSince = 0;
 
-        if (imgZ != NULL)
-            delete imgZ;
-    }
+        // reset inactive seconds so we don't automatically disconnect
+        vnc->inactiveSeconds = 0;
+
+        // (an update is one message, so this is when it started coming in)
+        vnc->messageStartMs = svMonotonicMs();
+        vnc->messageStartCpuMs = svThreadCpuMs();
+
+        if (HandleRFBServerMessage(cl) == FALSE)
+            break;
+
+        // keep going while there's more to handle or this host is being viewed
+        if (cl->buffered > 0 || vnc->allowDrawing == true || app->nBackgroundInterval < 1)
+            continue;
+
+        struct pollfd fdSock;
+
+        fdSock.fd = cl->sock;
+        fdSock.events = POLLIN;
+        fdSock.revents = 0;
+
+        if (poll(&fdSock, 1, 0) > 0)
+            continue;
+
+        // caught up on a background host, so sit out the interval (sends
+        // still go out and being shown or stopped ends it early)
+        long nWakeAt = svMonotonicMs() + app->nBackgroundInterval;
+        long nNow = svMonotonicMs();
+
+        while (nNow < nWakeAt && vnc->stopDecoder == false && vnc->allowDrawing == false)
+        {
+            struct pollfd fdWake;
+
+            fdWake.fd = vnc->wakePipe[0];
+            fdWake.events = POLLIN;
+            fdWake.revents = 0;
+
+            if (poll(&fdWake, 1, static_cast<int>(nWakeAt - nNow)) > 0)
+            {
+                char buf[64];
+
+                while (read(vnc->wakePipe[0], buf, sizeof(buf)) > 0)
+                    ;
+
+                vnc->flushSendQueue();
+            }
+
+            // note when data started waiting
+            if (nPendingSince == 0 && poll(&fdSock, 1, 0) > 0)
+                nPendingSince = svMonotonicMs();
+
+            nNow = svMonotonicMs();
+        }
+
+        if (nPendingSince == 0 && poll(&fdSock, 1, 0) > 0)
+            nPendingSince = nNow;
+    }
+
+    // the connection dropped, so have the main thread end the viewer
+    if (vnc->stopDecoder == false)
+    {
+        vnc->decoderFailed = true;
+        Fl::awake(VncObject::handleDecoderEvents, NULL);
+    }
+
+    return SV_RET_VOID;
+}
+
+
+/*
+ * main thread side of the decoder threads: ends failed connections, does
+ * framebuffer reallocations and hands on cursors, clipboard text and redraws
+ * (static method / Fl::awake callback)
+ */
+void VncObject::handleDecoderEvents (void * notUsed)
+{
+    std::string strMessage;
+
+    (void) notUsed;
+
+    for (int i = 0; i <= app->hostList->size(); i ++)
+    {
+        HostItem * itm = static_cast<HostItem *>(app->hostList->data(i));
+
+        if (itm == NULL || itm->vnc == NULL)
+            continue;
+
+        VncObject * vnc = itm->vnc;
+
+        if (vnc->decoderFailed == true)
+        {
+            VncObject::endAndDeleteViewer(&itm->vnc);
+            continue;
+        }
+
+        // remote resize (allocFrameBuffer takes the buffer lock itself)
+        pthread_mutex_lock(&vnc->bufferMutex);
+        bool mallocRequested = (vnc->mallocRequested == true && vnc->mallocDone == false);
+        pthread_mutex_unlock(&vnc->bufferMutex);
+
+        if (mallocRequested == true)
+        {
+            rfbBool result = vnc->allocFrameBuffer();
+
+            pthread_mutex_lock(&vnc->bufferMutex);
+            vnc->mallocResult = result;
+            vnc->mallocDone = true;
+            pthread_cond_broadcast(&vnc->mallocCond);
+            pthread_mutex_unlock(&vnc->bufferMutex);
+
+            // the viewer's size depends on the remote size
+            if (app->vncViewer->vnc == vnc)
+                vnc->setObjectVisible();
+        }
+
+        pthread_mutex_lock(&vnc->bufferMutex);
+
+        Fl_RGB_Image * cursor = vnc->pendingCursor;
+        int nCursorXHot = vnc->pendingCursorXHot;
+        int nCursorYHot = vnc->pendingCursorYHot;
+        bool hasClipboard = vnc->hasPendingClipboard;
+        std::string strClipboard = vnc->pendingClipboard;
+        bool needsRedraw = vnc->redrawPending;
+        bool hasBenchmark = vnc->hasPendingBenchmark;
+        std::string strBenchmark = vnc->pendingBenchmark;
+        std::string strBenchmarkReport = vnc->pendingBenchmarkReport;
+
+        vnc->hasPendingBenchmark = false;
+
+        vnc->pendingCursor = NULL;
+        vnc->hasPendingClipboard = false;
+        vnc->pendingClipboard.clear();
+
+        bool isShowing = (app->vncViewer->vnc == vnc && vnc->allowDrawing == true);
+
+        // (a viewer that's since been hidden has nothing to present)
+        if (isShowing == false)
+            vnc->redrawPending = false;
+
+        pthread_mutex_unlock(&vnc->bufferMutex);
+
+        // new remote cursor
+        if (cursor != NULL)
+        {
+            if (vnc->imgCursor != NULL)
+                delete vnc->imgCursor;
+
+            vnc->imgCursor = cursor;
+            vnc->nCursorXHot = nCursorXHot;
+            vnc->nCursorYHot = nCursorYHot;
+
+            if (isShowing == true && Fl::belowmouse() == app->vncViewer)
+                app->mainWin->cursor(vnc->imgCursor, vnc->nCursorXHot, vnc->nCursorYHot);
+        }
+
+        // copy/cut from the host we're looking at
+        if (hasClipboard == true && app->vncViewer->vnc == vnc)
+        {
+            app->blockLocalClipboardHandling = true;
+
+            Fl::copy(strClipboard.c_str(), static_cast<int>(strClipboard.size()), 1);
+
+            vnc->sendUpdateRequest(false);
+
+            app->blockLocalClipboardHandling = false;
+        }
+
+        // encoding benchmark finished, so keep the winner
+        if (hasBenchmark == true)
+        {
+            if (strBenchmark != "")
+            {
+                itm->encodings = strBenchmark + " copyrect";
+                svConfigWrite();
+            }
+
+            // (re-sends the encodings, now with the winner)
+            VncSendItem item('e', (vnc->lowCostProfile == true ? 1 : 0));
+            item.text = itm->encodings;
+            vnc->queueSend(item);
+
+            svLogToFile("Encoding benchmark for '" + itm->name + "' - " + strBenchmarkReport);
+
+            // (shown once we're done with the host list, as it runs its own event loop)
+            strMessage = "Full refresh times for '" + itm->name + "':\n\n" +
+                strBenchmarkReport + "\n" + (strBenchmark != "" ? "Now using " + strBenchmark :
+                "No encoding answered, so nothing was changed");
+        }
+
+        if (needsRedraw == true && isShowing == true)
+            vnc->schedulePresent();
+    }
+
+    if (strMessage != "")
+        svMessageWindow(strMessage);
+}
+
+
+/*
+ * present decoded updates to the viewer, at most app->nMaxFps times a
+ * second.  Anything decoded while a present waits for its slot is merged
+ * into it (the decoder doesn't wake us again until it's done)
+ * (instance method)
+ */
+void VncObject::schedulePresent ()
+{
+    if (presentScheduled == true)
+        return;
+
+    long nInterval = (app->nMaxFps > 0 ? 1000 / app->nMaxFps : 0);
+    long nWait = lastPresentMs + nInterval - svMonotonicMs();
+
+    if (nWait > 0)
+    {
+        // the display can't show it yet
+        presentScheduled = true;
+        framesDeferred ++;
+
+        Fl::add_timeout(nWait / 1000.0, VncObject::handlePresentTimer, this);
+        return;
+    }
+
+    presentFrame();
+}
+
+
+/* fltk timer for a present that had to wait for its slot */
+/* (static method) */
+void VncObject::handlePresentTimer (void * data)
+{
+    VncObject * vnc = static_cast<VncObject *>(data);
+
+    if (vnc == NULL)
+        return;
+
+    vnc->presentScheduled = false;
+
+    if (app->vncViewer->vnc == vnc && vnc->allowDrawing == true)
+        vnc->presentFrame();
+}
+
+
+/*
+ * hand everything decoded since the last present to fltk as damage, so the
+ * next draw shows it
+ * (instance method)
+ */
+void VncObject::presentFrame ()
+{
+    pthread_mutex_lock(&bufferMutex);
+
+    for (size_t i = 0; i < drawRects.size(); i ++)
+        VncObject::addDamageRect(presentRects, drawRects[i]);
+
+    drawRects.clear();
+    redrawPending = false;
+
+    pthread_mutex_unlock(&bufferMutex);
+
+    lastPresentMs = svMonotonicMs();
+    framesPresented ++;
+
+    if (itm == NULL || presentRects.empty() == true)
+        return;
+
+    // scaled viewers damage the part of the scaled image each rectangle lands on
+    bool scaled = isScaled();
+
+    int nOriginX = app->scroller->x() - app->scroller->xposition();
+    int nOriginY = app->scroller->y() - app->scroller->yposition();
+
+    if (scaled == true)
+    {
+        nOriginX = app->vncViewer->x();
+        nOriginY = app->vncViewer->y();
+    }
+
+    for (size_t i = 0; i < presentRects.size(); i ++)
+    {
+        VncRect r = presentRects[i];
+
+        if (scaled == true)
+            svScaledRectBounds(bufferW, bufferH, app->vncViewer->w(), app->vncViewer->h(),
+                r.x, r.y, r.w, r.h);
+
+        app->vncViewer->damage(FL_DAMAGE_USER1, nOriginX + r.x, nOriginY + r.y, r.w, r.h);
+    }
+}
+
+
+/* start this host's decoder thread once it's connected */
+/* (instance method) */
+void VncObject::startDecoder ()
+{
+    if (vncClient == NULL || vncClient->sock < 0 || decoderRunning == true)
+        return;
+
+    if (pipe(wakePipe) != 0)
+    {
+        svLogToFile("ERROR - Could not create the decoder wake pipe for '" + itm->name + "'");
+        return;
+    }
+
+    fcntl(wakePipe[0], F_SETFL, fcntl(wakePipe[0], F_GETFL) | O_NONBLOCK);
+    fcntl(wakePipe[1], F_SETFL, fcntl(wakePipe[1], F_GETFL) | O_NONBLOCK);
+
+    stopDecoder = false;
+    decoderFailed = false;
+
+    // set before the thread exists so its malloc callback can see it
+    decoderRunning = true;
+
+    if (pthread_create(&threadDecoder, NULL, VncObject::decoderThread, this) != 0)
+    {
+        decoderRunning = false;
+        decoderFailed = true;
+        svLogToFile("ERROR - Could not create the decoder thread for '" + itm->name + "'");
+        Fl::awake(VncObject::handleDecoderEvents, NULL);
+    }
+}
+
+
+/* stop this host's decoder thread and wait for it to finish */
+/* (instance method) */
+void VncObject::stopDecoderThread ()
+{
+    if (decoderRunning == true)
+    {
+        // also wakes the thread if it's waiting on a framebuffer
+        pthread_mutex_lock(&bufferMutex);
+        stopDecoder = true;
+        pthread_cond_broadcast(&mallocCond);
+        pthread_mutex_unlock(&bufferMutex);
+
+        wakeDecoder();
+
+        // unblocks a read/write the thread is in the middle of
+        if (vncClient != NULL && vncClient->sock >= 0)
+            shutdown(vncClient->sock, SHUT_RDWR);
+
+        pthread_join(threadDecoder, NULL);
+
+        decoderRunning = false;
+    }
+
+    if (wakePipe[0] != -1)
+        close(wakePipe[0]);
+
+    if (wakePipe[1] != -1)
+        close(wakePipe[1]);
+
+    wakePipe[0] = -1;
+    wakePipe[1] = -1;
+
+    pthread_mutex_lock(&sendMutex);
+    sendQueue.clear();
+    pthread_mutex_unlock(&sendMutex);
+
+    pthread_mutex_lock(&bufferMutex);
+
+    if (pendingCursor != NULL)
+        delete pendingCursor;
+
+    pendingCursor = NULL;
+    hasPendingClipboard = false;
+    redrawPending = false;
+
+    pthread_mutex_unlock(&bufferMutex);
+}
+
+
+/* queue a message for the decoder thread to send to the host */
+/* (instance method) */
+void VncObject::queueSend (const VncSendItem& item)
+{
+    // nobody to send it
+    if (decoderRunning == false || stopDecoder == true)
+        return;
+
+    // input shouldn't wait for the decoder to finish reading an update
+    if ((item.type == 'p' || item.type == 'k') && sendNow(item) == true)
+        return;
+
+    pthread_mutex_lock(&sendMutex);
+    sendQueue.push_back(item);
+    pthread_mutex_unlock(&sendMutex);
+
+    wakeDecoder();
+}
+
+
+/*
+ * write a pointer or key event to the host from the main thread, while the
+ * decoder may be blocked reading a large update.  Only done when nothing is
+ * queued ahead of it, the decoder isn't writing and the socket has room, so
+ * it never blocks and goes out in one write.  Returns false if the decoder
+ * has to send it instead
+ * (instance method)
+ */
+bool VncObject::sendNow (const VncSendItem& item)
+{
+    rfbClient * cl = vncClient;
+
+    if (cl == NULL || cl->sock < 0)
+        return false;
+
+    if (pthread_mutex_trylock(&writeMutex) != 0)
+        return false;
+
+    bool sent = false;
+
+    pthread_mutex_lock(&sendMutex);
+
+    if (sendQueue.empty() == true)
+    {
+        struct pollfd fdSock;
+
+        fdSock.fd = cl->sock;
+        fdSock.events = POLLOUT;
+        fdSock.revents = 0;
+
+        if (poll(&fdSock, 1, 0) > 0 && (fdSock.revents & POLLOUT) != 0)
+        {
+            if (item.type == 'p')
+            {
+                SendPointerEvent(cl, item.a, item.b, item.c);
+                sentButtons = item.c;
+            }
+            else
+                SendKeyEvent(cl, item.a, (item.b == 1 ? TRUE : FALSE));
+
+            sent = true;
+        }
+    }
+
+    pthread_mutex_unlock(&sendMutex);
+    pthread_mutex_unlock(&writeMutex);
+
+    return sent;
+}
+
+
+/* wake the decoder thread if it's waiting on the socket or sitting out its interval */
+/* (instance method) */
+void VncObject::wakeDecoder ()
+{
+    if (wakePipe[1] == -1)
+        return;
+
+    // (a full pipe means it's going to wake anyway)
+    if (write(wakePipe[1], "x", 1) < 0 && errno != EAGAIN)
+        svDebugLog("wakeDecoder - Could not write to the wake pipe");
+}
+
+
+/*
+ * send a pointer event to the host.  Motion is held for up to
+ * SV_POINTER_COALESCE_MS so only its latest position goes out; button
+ * and wheel events go out right away and replace any held motion
+ * (instance method)
+ */
+void VncObject::sendPointerEvent (int x, int y, int buttons, bool motion)
+{
+    if (motion == true)
+    {
+        if (hasPendingMotion == false)
+            Fl::add_timeout(SV_POINTER_COALESCE_MS / 1000.0, VncObject::handlePointerTimer, this);
+
+        hasPendingMotion = true;
+        pendingMotionX = x;
+        pendingMotionY = y;
+        pendingMotionButtons = buttons;
+        return;
+    }
+
+    // (this event carries the newest position anyway)
+    if (hasPendingMotion == true)
+    {
+        Fl::remove_timeout(VncObject::handlePointerTimer, this);
+        hasPendingMotion = false;
+    }
+
+    queueSend(VncSendItem('p', x, y, buttons));
+}
+
+
+/* send held pointer motion to the host */
+/* (instance method) */
+void VncObject::flushPointerMotion ()
+{
+    if (hasPendingMotion == false)
+        return;
+
+    hasPendingMotion = false;
+
+    queueSend(VncSendItem('p', pendingMotionX, pendingMotionY, pendingMotionButtons));
+
+    // dragging, so ask for the result
+    if (pendingMotionButtons != 0)
+        sendUpdateRequest(true);
+}
+
+
+/* fltk timer that ends a pointer motion coalescing window */
+/* (static method) */
+void VncObject::handlePointerTimer (void * data)
+{
+    VncObject * vnc = static_cast<VncObject *>(data);
+
+    if (vnc != NULL)
+        vnc->flushPointerMotion();
+}
+
+
+/* send a key event to the host */
+/* (instance method) */
+void VncObject::sendKeyEvent (int keySym, bool down)
+{
+    queueSend(VncSendItem('k', keySym, (down == true ? 1 : 0)));
+}
+
+
+/*
+ * send a run of key events to the host.  With no delay they all go out
+ * in one write; otherwise they go out one at a time, delayMs apart, from
+ * an fltk timer
+ * (instance method)
+ */
+void VncObject::sendKeyBatch (const std::vector<VncKeyEvent>& keys, int delayMs)
+{
+    if (keys.empty() == true)
+        return;
+
+    // still working through an earlier schedule, so these wait their turn
+    if (keySchedule.empty() == false)
+    {
+        keySchedule.insert(keySchedule.end(), keys.begin(), keys.end());
+        return;
+    }
+
+    if (delayMs <= 0)
+    {
+        VncSendItem item('K');
+        item.keys = keys;
+        queueSend(item);
+        return;
+    }
+
+    keySchedule = keys;
+    keyScheduleDelay = delayMs;
+    keyScheduleNext = 0;
+
+    VncObject::handleKeyTimer(this);
+}
+
+
+/* fltk timer that sends the next scheduled key event */
+/* (static method) */
+void VncObject::handleKeyTimer (void * data)
+{
+    VncObject * vnc = static_cast<VncObject *>(data);
+
+    if (vnc == NULL || vnc->keyScheduleNext >= vnc->keySchedule.size())
+        return;
+
+    VncKeyEvent& key = vnc->keySchedule[vnc->keyScheduleNext];
+    vnc->sendKeyEvent(key.keySym, key.down);
+
+    vnc->keyScheduleNext ++;
+
+    // all sent
+    if (vnc->keyScheduleNext >= vnc->keySchedule.size())
+    {
+        vnc->keySchedule.clear();
+        vnc->keyScheduleNext = 0;
+        return;
+    }
+
+    Fl::add_timeout(vnc->keyScheduleDelay / 1000.0, VncObject::handleKeyTimer, vnc);
+}
+
+
+/* send local clipboard text to the host */
+/* (instance method) */
+void VncObject::sendClientCutText (const std::string& text)
+{
+    VncSendItem item('c');
+
+    item.text = text;
+
+    queueSend(item);
+}
+
+
+/* ask the host for a framebuffer update (the whole screen if not incremental) */
+/* (instance method) */
+void VncObject::sendUpdateRequest (bool incremental)
+{
+    queueSend(VncSendItem('u', (incremental == true ? 1 : 0)));
+}
+
+
+/*
+ * switch a hidden host to cheap updates (low jpeg quality, high compression)
+ * or back to the host item's own levels.  Hidden hosts are also only
+ * serviced every app->nBackgroundInterval ms (see decoderThread), which
+ * limits how often they ask for updates
+ * (instance method)
+ */
+void VncObject::setLowCostProfile (bool lowCost)
+{
+    if (lowCost == true && app->backgroundSaver == false)
+        return;
+
+    if (lowCost == lowCostProfile)
+        return;
+
+    lowCostProfile = lowCost;
+
+    // (the decoder gets its own copy of the host item's list)
+    VncSendItem item('e', (lowCost == true ? 1 : 0));
+    item.text = itm->encodings;
+    queueSend(item);
+}
+
+
+/*
+ * limit the host's updates to the part of its screen that can be seen.
+ * Scrolled viewers get the visible area plus a margin, so small scrolls
+ * don't need anything new, and ask again once the view leaves that area.
+ * Scaled viewers show (and get) the whole screen.  Forcing asks for the
+ * whole area again even if it hasn't moved
+ * (instance method)
+ */
+void VncObject::updateViewport (bool force)
+{
+    if (itm == NULL || vncClient == NULL || bufferW < 1 || bufferH < 1)
+        return;
+
+    VncRect r(0, 0, bufferW, bufferH);
+
+    if (isScaled() == false)
+    {
+        int nX = std::max(app->scroller->xposition(), 0);
+        int nY = std::max(app->scroller->yposition(), 0);
+        int nX2 = std::min(nX + app->scroller->w(), bufferW);
+        int nY2 = std::min(nY + app->scroller->h(), bufferH);
+
+        // still inside the area we're getting updates for
+        if (force == false
+            && nX >= requestRect.x && nX2 <= requestRect.x + requestRect.w
+            && nY >= requestRect.y && nY2 <= requestRect.y + requestRect.h)
+            return;
+
+        r.x = std::max(nX - SV_VIEWPORT_MARGIN, 0);
+        r.y = std::max(nY - SV_VIEWPORT_MARGIN, 0);
+        r.w = std::min(nX2 + SV_VIEWPORT_MARGIN, bufferW) - r.x;
+        r.h = std::min(nY2 + SV_VIEWPORT_MARGIN, bufferH) - r.y;
+    }
+
+    if (force == false && r.x == requestRect.x && r.y == requestRect.y
+        && r.w == requestRect.w && r.h == requestRect.h)
+        return;
+
+    requestRect = r;
+
+    queueSend(VncSendItem('v', r.x, r.y, r.w, r.h));
+}
+
+
+/*
+ * adaptive quality controller, run after each update on the decoder thread.
+ * Every couple of seconds it compares the average time from requesting an
+ * update to having it decoded with SV_ADAPT_TARGET_MS.  Too slow steps quality down
+ * and compression up; plenty of headroom steps back toward the host item's
+ * levels, which are the best it goes.  When decoding rather than the
+ * network is what takes the time, a fast link gets hextile (cheap to decode,
+ * more bytes) ahead of tight, until that turns out to be too slow
+ * (instance method)
+ */
+void VncObject::adaptEncodings ()
+{
+    long nNow = svMonotonicMs();
+
+    if (adaptWindowStart == 0)
+        adaptWindowStart = nNow;
+
+    if (nNow - adaptWindowStart < SV_ADAPT_INTERVAL_MS || adaptFrames < SV_ADAPT_MIN_FRAMES)
+        return;
+
+    long nAvgFrameMs = adaptFrameMs / adaptFrames;
+    long nAvgCpuMs = adaptCpuMs / adaptFrames;
+    long nPixelsPerSec = adaptPixels * 1000 / (nNow - adaptWindowStart);
+
+    adaptWindowStart = nNow;
+    adaptFrames = 0;
+    adaptFrameMs = 0;
+    adaptCpuMs = 0;
+    adaptPixels = 0;
+
+    // hidden hosts have their own cheap profile (and benchmarks their own encodings)
+    if (itm == NULL || itm->adaptiveQuality == false || encodingsLowCost == true
+        || benchEncoding != "")
+        return;
+
+    int nMaxStep = std::max(itm->qualityLevel, 9 - itm->compressLevel);
+    int nStep = adaptStep;
+    bool lan = adaptLanEncodings;
+
+    if (nAvgFrameMs > SV_ADAPT_TARGET_MS * 5 / 4)
+    {
+        // too slow, so cheaper encodings first, then cheaper levels
+        if (lan == true)
+        {
+            lan = false;
+            adaptLanFailed = true;
+        }
+        else if (nStep < nMaxStep)
+            nStep ++;
+    }
+    else if (nAvgFrameMs < SV_ADAPT_TARGET_MS / 2)
+    {
+        // room to spare, so better levels, then cheaper decoding if that's the bottleneck
+        if (nStep > 0)
+            nStep --;
+        else if (lan == false && adaptLanFailed == false && nAvgCpuMs * 2 > nAvgFrameMs)
+            lan = true;
+    }
+
+    if (nStep == adaptStep && lan == adaptLanEncodings)
+        return;
+
+    char strMsg[256] = {};
+
+    snprintf(strMsg, sizeof(strMsg), "adaptEncodings - '%s' updates averaged %li ms (%li ms"
+        " decoding, %li pixels/s), moving to step %i%s", itm->name.c_str(), nAvgFrameMs,
+        nAvgCpuMs, nPixelsPerSec, nStep, (lan == true ? " with hextile first" : ""));
+    svDebugLog(strMsg);
+
+    adaptStep = nStep;
+    adaptLanEncodings = lan;
+
+    applyEncodings();
+}
+
+
+/*
+ * send the encodings, quality and compression for the host's current state:
+ * the cheap profile while hidden, otherwise the host item's levels moved by
+ * the adaptive controller (decoder thread only)
+ * (instance method)
+ */
+void VncObject::applyEncodings ()
+{
+    rfbClient * cl = vncClient;
+
+    // a benchmark puts these back when it's done
+    if (cl == NULL || itm == NULL || benchEncoding != "")
+        return;
+
+    if (encodingsLowCost == true)
+    {
+        cl->appData.qualityLevel = SV_SAVER_QUALITY_LEVEL;
+        cl->appData.compressLevel = SV_SAVER_COMPRESS_LEVEL;
+    }
+    else
+    {
+        cl->appData.qualityLevel = std::max(itm->qualityLevel - adaptStep, 0);
+        cl->appData.compressLevel = std::min(itm->compressLevel + adaptStep, 9);
+    }
+
+    // the host item's own list always wins
+    if (hostEncodings != "")
+        encodingsList = hostEncodings;
+    else if (adaptLanEncodings == true && encodingsLowCost == false)
+        encodingsList = SV_LAN_ENCODINGS;
+    else
+        encodingsList = SV_ENCODINGS;
+
+    cl->appData.encodingsString = encodingsList.c_str();
+
+    // (same pixel format, so nothing in flight is decoded differently)
+    SetFormatAndEncodings(cl);
+}
+
+
+/*
+ * time a full screen refresh with each of SV_BENCH_ENCODINGS in turn (one
+ * per update request, see handleFrameBufferUpdate) and have the main thread
+ * store the fastest as the host item's encodings (decoder thread only)
+ * (instance method)
+ */
+void VncObject::startBenchmark ()
+{
+    if (benchEncoding != "" || vncClient == NULL || itm == NULL)
+        return;
+
+    std::string strList = SV_BENCH_ENCODINGS;
+    std::string strName;
+
+    benchQueue.clear();
+
+    for (size_t i = 0; i <= strList.size(); i ++)
+    {
+        if (i < strList.size() && strList[i] != ' ')
+        {
+            strName += strList[i];
+            continue;
+        }
+
+        if (strName != "")
+            benchQueue.push_back(strName);
+
+        strName = "";
+    }
+
+    benchBest = "";
+    benchBestMs = 0;
+    benchReport = "";
+
+    svLogToFile("Benchmarking encodings for '" + itm->name + "'");
+
+    benchmarkNext();
+}
+
+
+/* move the encoding benchmark on to its next encoding, or finish it */
+/* (instance method) */
+void VncObject::benchmarkNext ()
+{
+    rfbClient * cl = vncClient;
+
+    if (benchQueue.empty() == true)
+    {
+        benchEncoding = "";
+
+        pthread_mutex_lock(&bufferMutex);
+        pendingBenchmark = benchBest;
+        pendingBenchmarkReport = benchReport;
+        hasPendingBenchmark = true;
+        pthread_mutex_unlock(&bufferMutex);
+
+        Fl::awake(VncObject::handleDecoderEvents, NULL);
+
+        // back to what we were using until the main thread stores the result
+        applyEncodings();
+        return;
+    }
+
+    benchEncoding = benchQueue.front();
+    benchQueue.erase(benchQueue.begin());
+
+    // copyrect costs nothing and every real list has it
+    encodingsList = benchEncoding + " copyrect";
+    cl->appData.encodingsString = encodingsList.c_str();
+
+    SetFormatAndEncodings(cl);
+
+    benchPixels = 0;
+    benchRequestMs = svMonotonicMs();
+    fullRequestMs = benchRequestMs;
+
+    // the whole screen, whatever the viewport
+    SendFramebufferUpdateRequest(cl, 0, 0, cl->width, cl->height, FALSE);
+}
+
+
+/* give up on a benchmark encoding the host isn't answering for */
+/* (instance method) */
+void VncObject::checkBenchmark ()
+{
+    if (benchEncoding == "" || svMonotonicMs() - benchRequestMs < SV_BENCH_TIMEOUT_MS)
+        return;
+
+    benchReport += benchEncoding + ": no answer\n";
+
+    benchmarkNext();
+}
+
+
+/* send everything queued for the host (decoder thread only) */
+/* (instance method) */
+void VncObject::flushSendQueue ()
+{
+    std::vector<VncSendItem> items;
+
+    // (taken first, so sendNow can't get ahead of what's taken off the queue)
+    pthread_mutex_lock(&writeMutex);
+
+    pthread_mutex_lock(&sendMutex);
+    items.swap(sendQueue);
+    pthread_mutex_unlock(&sendMutex);
+
+    rfbClient * cl = vncClient;
+
+    for (size_t i = 0; i < items.size(); i ++)
+    {
+        VncSendItem& item = items[i];
+
+        switch (item.type)
+        {
+            case 'p':
+                // motion the decoder fell behind on only needs its last position
+                // (button changes always go out, where they happened)
+                if (item.c == sentButtons && i + 1 < items.size() && items[i + 1].type == 'p'
+                    && items[i + 1].c == item.c)
+                    break;
+
+                SendPointerEvent(cl, item.a, item.b, item.c);
+                sentButtons = item.c;
+                break;
+            case 'k':
+                SendKeyEvent(cl, item.a, (item.b == 1 ? TRUE : FALSE));
+                break;
+            case 'K':
+              {
+                // every event of the batch in one write
+                std::vector<rfbKeyEventMsg> msgs(item.keys.size());
+
+                for (size_t j = 0; j < item.keys.size(); j ++)
+                {
+                    memset(&msgs[j], 0, sizeof(rfbKeyEventMsg));
+                    msgs[j].type = rfbKeyEvent;
+                    msgs[j].down = (item.keys[j].down == true ? 1 : 0);
+                    msgs[j].key = htonl(item.keys[j].keySym);
+                }
+
+                if (msgs.empty() == false
+                    && WriteToRFBServer(cl, reinterpret_cast<char *>(&msgs[0]),
+                    msgs.size() * sz_rfbKeyEventMsg) == FALSE)
+                    svDebugLog("flushSendQueue - Could not send key batch");
+                break;
+              }
+            case 'c':
+                SendClientCutText(cl, const_cast<char *>(item.text.c_str()),
+                    static_cast<int>(item.text.size()));
+                break;
+            case 'e':
+                encodingsLowCost = (item.a == 1);
+                hostEncodings = item.text;
+                applyEncodings();
+                break;
+            case 'b':
+                startBenchmark();
+                break;
+            case 'u':
+                // (both only cover the viewport, see updateViewport)
+                if (item.a == 1)
+                    SendIncrementalFramebufferUpdateRequest(cl);
+                else
+                {
+                    SendFramebufferUpdateRequest(cl, cl->updateRect.x, cl->updateRect.y,
+                        cl->updateRect.w, cl->updateRect.h, FALSE);
+                    fullRequestMs = svMonotonicMs();
+                }
+                break;
+            case 's':
+#ifdef SV_HAVE_EXT_DESKTOP_SIZE
+                // (a host that doesn't support it ignores it, see checkRemoteResize)
+                SendExtDesktopSize(cl, item.a, item.b);
+#endif
+                break;
+            case 'v':
+                // a remote resize since this was queued makes it meaningless
+                if (item.a + item.c > cl->width || item.b + item.d > cl->height)
+                    break;
+
+                // libvnc asks for this area after every update from now on
+                cl->updateRect.x = item.a;
+                cl->updateRect.y = item.b;
+                cl->updateRect.w = item.c;
+                cl->updateRect.h = item.d;
+
+                SendFramebufferUpdateRequest(cl, item.a, item.b, item.c, item.d, FALSE);
+                fullRequestMs = svMonotonicMs();
+                break;
+            default:
+                break;
+        }
+    }
+
+    pthread_mutex_unlock(&writeMutex);
+}
+
+
+/*
+ * ########################################################################################
+ * ########################## VNC VIEWER WIDGET ###########################################
+ * ########################################################################################
+ */
+/* draw event for vnc view widget */
+/* (instance method) */
+void VncViewer::draw ()
+{
+    VncObject * vnc = app->vncViewer->vnc;
+
+    if (vnc == NULL ||
+        vnc->allowDrawing == false ||
+        vnc->vncClient == NULL)
+        return;
+
+    rfbClient * cl = vnc->vncClient;
+    HostItem * itm = static_cast<HostItem *>(vnc->itm);
+
+    if (cl == NULL || itm == NULL)
+        return;
+
+    // scrolling may have brought part of the screen we don't get updates for into view
+    vnc->updateViewport(false);
+
+    // the decoder thread can't swap buffers while we draw from them
+    pthread_mutex_lock(&vnc->bufferMutex);
+
+    if (vnc->frontBuffer != NULL)
+        drawFrame(vnc, cl, itm);
+
+    // the x server has to be done reading shared memory before the decoder
+    // can swap or scale into it again
+    if (vnc->shmFront != NULL || vnc->shmScaled != NULL)
+        svShmSync();
+
+    pthread_mutex_unlock(&vnc->bufferMutex);
+}
+
+
+/* draw the viewer from the front buffer (called with the buffer lock held) */
+/* (instance method) */
+void VncViewer::drawFrame (VncObject * vnc, rfbClient * cl, HostItem * itm)
+{
+    int nBytesPerPixel = cl->format.bitsPerPixel / 8;
+
+    // get out if buffer or scroller size is wrong
+    if (vnc->bufferW < 1 || vnc->bufferH < 1 || app->scroller->w() < 1 || app->scroller->h() < 1)
+        return;
+
+    // 's'croll or 'f'it + real size scale mode geometry
+    if (vnc->isScaled() == false)
+    {
+        int nOriginX = app->scroller->x() - app->scroller->xposition();
+        int nOriginY = app->scroller->y() - app->scroller->yposition();
+
+        // only the damaged rectangles changed, so only draw those
+        if (damage() == FL_DAMAGE_USER1)
+        {
+            for (size_t i = 0; i < vnc->presentRects.size(); i ++)
+            {
+                const VncRect& r = vnc->presentRects[i];
+
+                fl_push_clip(nOriginX + r.x, nOriginY + r.y, r.w, r.h);
+                drawBufferRect(vnc->frontBuffer, vnc->bufferW, vnc->bufferH, nBytesPerPixel,
+                    r.x, r.y, r.w, r.h, nOriginX, nOriginY, vnc->shmFront);
+                fl_pop_clip();
+            }
+        }
+        else
+            // draw that vnc host!
+            drawBufferRect(vnc->frontBuffer, vnc->bufferW, vnc->bufferH, nBytesPerPixel,
+                0, 0, vnc->bufferW, vnc->bufferH, nOriginX, nOriginY, vnc->shmFront);
+
+        vnc->presentRects.clear();
+
+        return;
+    }
+
+    // 'z'oom or 'f'it + oversized scale mode geometry
+    if (vnc->isScaled() == true)
+    {
+        int nDstW = w();
+        int nDstH = h();
+
+        if (nDstW < 1 || nDstH < 1 || (nBytesPerPixel != 2 && nBytesPerPixel != 4))
+            return;
+
+        // channel layout of 2-byte pixels
+        SVScaleFormat scaleFormat;
+
+        scaleFormat.redShift = cl->format.redShift;
+        scaleFormat.greenShift = cl->format.greenShift;
+        scaleFormat.blueShift = cl->format.blueShift;
+        scaleFormat.redMax = cl->format.redMax;
+        scaleFormat.greenMax = cl->format.greenMax;
+        scaleFormat.blueMax = cl->format.blueMax;
+
+        // rebuild the whole scaled image only when the viewer or remote screen
+        // changes size (or scaling quality changes)
+        if (vnc->scaledValid == false
+            || vnc->scaledBuffer == NULL
+            || vnc->scaledW != nDstW
+            || vnc->scaledH != nDstH
+            || vnc->scaledSrcW != vnc->bufferW
+            || vnc->scaledSrcH != vnc->bufferH
+            || vnc->scaledFast != itm->scalingFast)
+        {
+            if (vnc->scaledBuffer == NULL || vnc->scaledW != nDstW || vnc->scaledH != nDstH)
+            {
+                vnc->freeScaledBuffer();
+
+                // a native format framebuffer scales to a native format image, which
+                // needs x to draw it, so put that in shared memory too if possible
+                if (vnc->nativeFormat == true)
+                    vnc->shmScaled = svShmCreate(nDstW, nDstH);
+
+                if (vnc->shmScaled != NULL)
+                    vnc->scaledBuffer = vnc->shmScaled->data;
+                else
+                    vnc->scaledBuffer = new unsigned char[nDstW * nDstH * nBytesPerPixel];
+
+                vnc->scaledW = nDstW;
+                vnc->scaledH = nDstH;
+            }
+
+            vnc->scaledSrcW = vnc->bufferW;
+            vnc->scaledSrcH = vnc->bufferH;
+            vnc->scaledFast = itm->scalingFast;
+
+            svScaleImageRect(vnc->frontBuffer, vnc->bufferW, vnc->bufferH, vnc->scaledBuffer,
+                nDstW, nDstH, nBytesPerPixel, 0, 0, nDstW, nDstH, itm->scalingFast, &scaleFormat);
+
+            vnc->scaledValid = true;
+            vnc->presentRects.clear();
+
+            drawBufferRect(vnc->scaledBuffer, nDstW, nDstH, nBytesPerPixel,
+                0, 0, nDstW, nDstH, x(), y(), vnc->shmScaled);
+
+            return;
+        }
+
+        bool partial = (damage() == FL_DAMAGE_USER1);
+
+        // rescale only the parts of the remote screen that changed
+        for (size_t i = 0; i < vnc->presentRects.size(); i ++)
+        {
+            VncRect r = vnc->presentRects[i];
+
+            svScaledRectBounds(vnc->bufferW, vnc->bufferH, nDstW, nDstH, r.x, r.y, r.w, r.h);
+
+            svScaleImageRect(vnc->frontBuffer, vnc->bufferW, vnc->bufferH, vnc->scaledBuffer,
+                nDstW, nDstH, nBytesPerPixel, r.x, r.y, r.w, r.h, itm->scalingFast, &scaleFormat);
+
+            if (partial == true)
+            {
+                fl_push_clip(x() + r.x, y() + r.y, r.w, r.h);
+                drawBufferRect(vnc->scaledBuffer, nDstW, nDstH, nBytesPerPixel,
+                    r.x, r.y, r.w, r.h, x(), y(), vnc->shmScaled);
+                fl_pop_clip();
+            }
+        }
+
+        vnc->presentRects.clear();
+
+        if (partial == false)
+            drawBufferRect(vnc->scaledBuffer, nDstW, nDstH, nBytesPerPixel,
+                0, 0, nDstW, nDstH, x(), y(), vnc->shmScaled);
+    }
+}
+
+
+/*
+ * draw part of an image buffer, skipping anything outside the clip region
+ * ('shm' is the shared memory image behind 'buf', if it has one)
+ * (instance method)
+ */
+void VncViewer::drawBufferRect (const unsigned char * buf, int nBufW, int nBufH,
+    int nBytesPerPixel, int x, int y, int w, int h, int nOriginX, int nOriginY,
+    SVShmImage * shm)
+{
+    int nX, nY, nW, nH;
+
+    if (buf == NULL)
+        return;
+
+    // keep the rectangle inside the buffer
+    if (x < 0)
+    {
+        w += x;
+        x = 0;
+    }
+
+    if (y < 0)
+    {
+        h += y;
+        y = 0;
+    }
+
+    if (x + w > nBufW)
+        w = nBufW - x;
+
+    if (y + h > nBufH)
+        h = nBufH - y;
+
+    if (w < 1 || h < 1)
+        return;
+
+    // find the part of this rectangle that's actually visible
+    fl_clip_box(nOriginX + x, nOriginY + y, w, h, nX, nY, nW, nH);
+
+    if (nW < 1 || nH < 1)
+        return;
+
+    x = nX - nOriginX;
+    y = nY - nOriginY;
+
+    // already in the display's format, so hand it straight to x
+    if (shm != NULL)
+    {
+        svShmPut(shm, x, y, nX, nY, nW, nH);
+        return;
+    }
+
+    if (vnc != NULL && vnc->nativeFormat == true)
+    {
+        svNativePut(buf, nBufW, nBufH, nBytesPerPixel, x, y, nX, nY, nW, nH);
+        return;
+    }
+
+    fl_draw_image(
+        buf + (y * nBufW + x) * nBytesPerPixel,
+        nX,
+        nY,
+        nW,
+        nH,
+        nBytesPerPixel,
+        nBufW * nBytesPerPixel);
 }
 
 
@@ -985,14 +2956,14 @@ int VncViewer::handle (int event)
         return 0;
 
     // scrolled / non-scaled sizing
-    if (itm->scaling == 's' || (itm->scaling == 'f' && vnc->fitsScroller() == true))
+    if (vnc->isScaled() == false)
     {
         nMouseX = Fl::event_x() - app->scroller->x() + app->scroller->xposition();
         nMouseY = Fl::event_y() - app->scroller->y() + app->scroller->yposition();
     }
 
     // scaled sizing
-    if (itm->scaling == 'z' || (itm->scaling == 'f' && vnc->fitsScroller() == false))
+    if (vnc->isScaled() == true)
     {
         float fXAdj = float(app->vncViewer->w()) / float(cl->width);
         float fYAdj = float(app->vncViewer->h()) / float(cl->height);
@@ -1011,8 +2982,7 @@ int VncViewer::handle (int event)
             if (Fl::event_button() == FL_RIGHT_MOUSE)
                 nButtonMask |= rfbButton3Mask;
 
-            SendPointerEvent(vnc->vncClient, nMouseX, nMouseY, nButtonMask);
-            SendIncrementalFramebufferUpdateRequest(vnc->vncClient);
+            vnc->sendPointerEvent(nMouseX, nMouseY, nButtonMask, true);
 
             app->scanIsRunning = false;
             return 1;
@@ -1023,8 +2993,8 @@ int VncViewer::handle (int event)
             if (Fl::event_button() == FL_LEFT_MOUSE)
             {
                 nButtonMask |= rfbButton1Mask;
-                SendPointerEvent(vnc->vncClient, nMouseX, nMouseY, nButtonMask);
-                //SendIncrementalFramebufferUpdateRequest(vnc->vncClient);
+                vnc->sendPointerEvent(nMouseX, nMouseY, nButtonMask);
+                //vnc->sendUpdateRequest(true);
                 app->scanIsRunning = false;
                 return 1;
             }
@@ -1032,8 +3002,8 @@ int VncViewer::handle (int event)
             if (Fl::event_button() == FL_RIGHT_MOUSE)
             {
                 nButtonMask |= rfbButton3Mask;
-                SendPointerEvent(vnc->vncClient, nMouseX, nMouseY, nButtonMask);
-                //SendIncrementalFramebufferUpdateRequest(vnc->vncClient);
+                vnc->sendPointerEvent(nMouseX, nMouseY, nButtonMask);
+                //vnc->sendUpdateRequest(true);
                 app->scanIsRunning = false;
                 return 1;
             }
@@ -1045,8 +3015,8 @@ int VncViewer::handle (int event)
             {
                 // left mouse click
                 nButtonMask &= ~rfbButton1Mask;
-                SendPointerEvent(vnc->vncClient, nMouseX, nMouseY, nButtonMask);
-                SendIncrementalFramebufferUpdateRequest(vnc->vncClient);
+                vnc->sendPointerEvent(nMouseX, nMouseY, nButtonMask);
+                vnc->sendUpdateRequest(true);
                 app->scanIsRunning = false;
                 return 1;
             }
@@ -1055,8 +3025,8 @@ int VncViewer::handle (int event)
             if (Fl::event_button() == FL_RIGHT_MOUSE)
             {
                 nButtonMask &= ~rfbButton3Mask;
-                SendPointerEvent(vnc->vncClient, nMouseX, nMouseY, nButtonMask);
-                SendIncrementalFramebufferUpdateRequest(vnc->vncClient);
+                vnc->sendPointerEvent(nMouseX, nMouseY, nButtonMask);
+                vnc->sendUpdateRequest(true);
                 app->scanIsRunning = false;
                 return 1;
             }
@@ -1078,18 +3048,18 @@ int VncViewer::handle (int event)
                     nYDirection = rfbWheelUpMask;
 
                 nButtonMask |= nYDirection;
-                SendPointerEvent(vnc->vncClient, nMouseX, nMouseY, nButtonMask);
+                vnc->sendPointerEvent(nMouseX, nMouseY, nButtonMask);
                 nButtonMask &= ~nYDirection;
-                SendPointerEvent(vnc->vncClient, nMouseX, nMouseY, nButtonMask);
-                SendIncrementalFramebufferUpdateRequest(vnc->vncClient);
+                vnc->sendPointerEvent(nMouseX, nMouseY, nButtonMask);
+                vnc->sendUpdateRequest(true);
                 return 1;
             }
             break;
         }
 
         case FL_MOVE:
-            SendPointerEvent(vnc->vncClient, nMouseX, nMouseY, nButtonMask);
-            //SendIncrementalFramebufferUpdateRequest(vnc->vncClient);
+            vnc->sendPointerEvent(nMouseX, nMouseY, nButtonMask, true);
+            //vnc->sendUpdateRequest(true);
             return 1;
             break;
 
@@ -1143,8 +3113,7 @@ int VncViewer::handle (int event)
               strncpy(strClipText, Fl::event_text(), intClipLen);
 
               // send clipboard text to remote server
-              SendClientCutText(app->vncViewer->vnc->vncClient,
-                const_cast<char *>(strClipText), intClipLen);
+              app->vncViewer->vnc->sendClientCutText(std::string(strClipText, intClipLen));
             }
             return 1;
         }
@@ -1178,13 +3147,13 @@ void VncViewer::sendCorrectedKeyEvent (const char * strIn, const int nKey,
     // F12 macro
     if (nK == XK_F12 && downState == false)
     {
-        svSendKeyStrokesToHost(itm->f12Macro, vnc);
+        svSendKeyStrokesToHost(itm->f12Macro, vnc, itm->f12MacroDelay);
         return;
     }
 
     // send key
     if ((nK >= 32 && nK <= 255) && Fl::event_ctrl() == 0)
-        SendKeyEvent(cl, strIn[0], downState);
+        vnc->sendKeyEvent(strIn[0], downState);
     else
-        SendKeyEvent(cl, nK, downState);
+        vnc->sendKeyEvent(nK, downState);
 }
@@ -38,10 +38,72 @@
 #include <FL/Fl_Box.H>
 #include <FL/Fl_Pixmap.H>
 #include <rfb/rfbclient.h>
+#include <pthread.h>
+#include <algorithm>
+#include <atomic>
 #include <fstream>
+#include <string>
+#include <vector>
 #include "hostitem.h"
 
 class HostItem;
+class SVShmImage;
+
+/* rectangle of remote framebuffer that needs redrawing */
+class VncRect
+{
+public:
+    VncRect (int x = 0, int y = 0, int w = 0, int h = 0) :
+        x(x),
+        y(y),
+        w(w),
+        h(h)
+    {}
+
+    int x;
+    int y;
+    int w;
+    int h;
+};
+
+/* one key press or release, for a key batch */
+class VncKeyEvent
+{
+public:
+    VncKeyEvent (int keySym = 0, bool down = false) :
+        keySym(keySym),
+        down(down)
+    {}
+
+    int keySym;
+    bool down;
+};
+
+/* message waiting to be sent to the host by the decoder thread */
+class VncSendItem
+{
+public:
+    VncSendItem (char type = 'u', int a = 0, int b = 0, int c = 0, int d = 0) :
+        type(type),
+        a(a),
+        b(b),
+        c(c),
+        d(d),
+        text("")
+    {}
+
+    // 'p'ointer (x, y, buttons), 'k'ey (keysym, down), 'c'lipboard (text),
+    // 'u'pdate request (incremental), 'e'ncodings (low cost, host item's list),
+    // 'v'iewport (x, y, w, h), desktop 's'ize (w, h), 'b'enchmark encodings,
+    // 'K'ey batch (keys)
+    char type;
+    int a;
+    int b;
+    int c;
+    int d;
+    std::string text;
+    std::vector<VncKeyEvent> keys;
+};
 
 /* vnc viewer class */
 class VncObject
@@ -59,58 +121,311 @@ public:
         nCursorYHot(0),
         inactiveSeconds(0),
         centeredX(0),
-        centeredY(0)
+        centeredY(0),
+        scaledBuffer(NULL),
+        scaledW(0),
+        scaledH(0),
+        scaledSrcW(0),
+        scaledSrcH(0),
+        scaledFast(false),
+        scaledValid(false),
+        frontBuffer(NULL),
+        bufferW(0),
+        bufferH(0),
+        shmFront(NULL),
+        shmBack(NULL),
+        shmScaled(NULL),
+        nativeFormat(false),
+        threadDecoder(0),
+        decoderRunning(false),
+        stopDecoder(false),
+        decoderFailed(false),
+        redrawPending(false),
+        mallocRequested(false),
+        mallocDone(false),
+        mallocResult(FALSE),
+        pendingCursor(NULL),
+        pendingCursorXHot(0),
+        pendingCursorYHot(0),
+        hasPendingClipboard(false),
+        pendingClipboard(""),
+        queuedBytes(0),
+        queuedBytesMax(0),
+        serviceWaitMax(0),
+        lowCostProfile(false),
+        remoteResizeW(0),
+        remoteResizeH(0),
+        remoteResizeTime(0),
+        remoteResizeRefused(false),
+        messageStartMs(0),
+        fullRequestMs(0),
+        adaptRttMs(0),
+        messageStartCpuMs(0),
+        adaptWindowStart(0),
+        adaptFrames(0),
+        adaptFrameMs(0),
+        adaptCpuMs(0),
+        adaptPixels(0),
+        adaptStep(0),
+        adaptLanEncodings(false),
+        adaptLanFailed(false),
+        encodingsLowCost(false),
+        encodingsList(""),
+        hostEncodings(""),
+        updatePixels(0),
+        benchEncoding(""),
+        benchRequestMs(0),
+        benchPixels(0),
+        benchBestMs(0),
+        benchBest(""),
+        benchReport(""),
+        hasPendingBenchmark(false),
+        pendingBenchmark(""),
+        pendingBenchmarkReport(""),
+        presentScheduled(false),
+        lastPresentMs(0),
+        framesDecoded(0),
+        framesPresented(0),
+        framesDeferred(0),
+        hasPendingMotion(false),
+        pendingMotionX(0),
+        pendingMotionY(0),
+        pendingMotionButtons(0),
+        sentButtons(0),
+        keyScheduleDelay(0),
+        keyScheduleNext(0),
+        connectRunning(false),
+        stopConnect(false),
+        connectOwnsClient(false)
     {
         // client and general rfb options
         vncClient->canHandleNewFBSize = true;
         vncClient->appData.forceTrueColour = false;
         vncClient->appData.useRemoteCursor = false;
         vncClient->listenPort = 5500;
+        rgbFormat = vncClient->format;
+
+        wakePipe[0] = -1;
+        wakePipe[1] = -1;
+        connectWakePipe[0] = -1;
+        connectWakePipe[1] = -1;
+
+        pthread_mutex_init(&bufferMutex, NULL);
+        pthread_mutex_init(&sendMutex, NULL);
+        pthread_mutex_init(&writeMutex, NULL);
+        pthread_cond_init(&mallocCond, NULL);
 
         // callbacks
+        vncClient->MallocFrameBuffer = VncObject::handleMallocFrameBuffer;
         vncClient->GetPassword = VncObject::handlePassword;
         vncClient->GotCursorShape = VncObject::handleCursorShapeChange;
         vncClient->GotXCutText = VncObject::handleRemoteClipboardProc;
+        vncClient->GotFrameBufferUpdate = VncObject::handleGotFrameBufferUpdate;
         vncClient->FinishedFrameBufferUpdate = VncObject::handleFrameBufferUpdate;
 
         rfbClientLog = VncObject::libVncLogging;
         rfbClientErr = VncObject::libVncLogging;
     }
 
+    ~VncObject ()
+    {
+        pthread_mutex_destroy(&bufferMutex);
+        pthread_mutex_destroy(&sendMutex);
+        pthread_mutex_destroy(&writeMutex);
+        pthread_cond_destroy(&mallocCond);
+    }
+
     // public variables
     rfbClient * vncClient;
     HostItem * itm;
-    bool allowDrawing;
+    // (read by the decoder thread)
+    std::atomic<bool> allowDrawing;
     int waitTime;
     int nLastClientWidth;
     int nLastClientHeight;
     Fl_RGB_Image * imgCursor;
     int nCursorXHot;
     int nCursorYHot;
-    int inactiveSeconds;
+    // (reset by the decoder thread, counted up by the main thread)
+    std::atomic<int> inactiveSeconds;
     int centeredX;
     int centeredY;
+    std::vector<VncRect> damageRects;
+    std::vector<VncRect> drawRects;
+    // damage handed to fltk, for the viewer's next draw (main thread only)
+    std::vector<VncRect> presentRects;
+    unsigned char * scaledBuffer;
+    int scaledW;
+    int scaledH;
+    int scaledSrcW;
+    int scaledSrcH;
+    bool scaledFast;
+    bool scaledValid;
+    // the decoder thread draws into vncClient->frameBuffer (the back buffer)
+    // and swaps it with frontBuffer, which the viewer draws from, after each
+    // update (bufferMutex guards the swap and everything marked 'pending')
+    unsigned char * frontBuffer;
+    int bufferW;
+    int bufferH;
+    SVShmImage * shmFront;
+    SVShmImage * shmBack;
+    SVShmImage * shmScaled;
+    bool nativeFormat;
+    rfbPixelFormat rgbFormat;
+    pthread_t threadDecoder;
+    bool decoderRunning;
+    std::atomic<bool> stopDecoder;
+    std::atomic<bool> decoderFailed;
+    int wakePipe[2];
+    pthread_mutex_t bufferMutex;
+    pthread_mutex_t sendMutex;
+    // held around our writes to the host's socket, from either thread
+    // (see sendNow)
+    pthread_mutex_t writeMutex;
+    pthread_cond_t mallocCond;
+    std::vector<VncSendItem> sendQueue;
+    bool redrawPending;
+    bool mallocRequested;
+    bool mallocDone;
+    rfbBool mallocResult;
+    Fl_RGB_Image * pendingCursor;
+    int pendingCursorXHot;
+    int pendingCursorYHot;
+    bool hasPendingClipboard;
+    std::string pendingClipboard;
+    // scheduling stats, written by the decoder thread: unread bytes from the
+    // host when last serviced, the most seen and the longest time (ms)
+    // readable data was left waiting
+    int queuedBytes;
+    int queuedBytesMax;
+    long serviceWaitMax;
+    bool lowCostProfile;
+    // part of the remote screen updates are asked for (main thread's copy)
+    VncRect requestRect;
+    // desktop size asked of the host in 'r' scaling mode (0 if none pending)
+    int remoteResizeW;
+    int remoteResizeH;
+    long remoteResizeTime;
+    bool remoteResizeRefused;
+    // adaptive quality controller (decoder thread only): frame timings for
+    // the current window and how far below the host item's quality it is
+    long messageStartMs;
+    long fullRequestMs;
+    long adaptRttMs;
+    long messageStartCpuMs;
+    long adaptWindowStart;
+    int adaptFrames;
+    long adaptFrameMs;
+    long adaptCpuMs;
+    long adaptPixels;
+    int adaptStep;
+    bool adaptLanEncodings;
+    bool adaptLanFailed;
+    bool encodingsLowCost;
+    std::string encodingsList;
+    // the host item's own encodings, copied in from each 'e' send item so the
+    // decoder thread never reads the host item's
+    std::string hostEncodings;
+    // encoding benchmark (decoder thread only, the result goes to the main
+    // thread as 'pending', like the cursor)
+    long updatePixels;
+    std::vector<std::string> benchQueue;
+    std::string benchEncoding;
+    long benchRequestMs;
+    long benchPixels;
+    long benchBestMs;
+    std::string benchBest;
+    std::string benchReport;
+    bool hasPendingBenchmark;
+    std::string pendingBenchmark;
+    std::string pendingBenchmarkReport;
+    // frame pacing: updates decoded for the viewer, presents made and
+    // presents deferred to their next frame slot by the frame rate cap
+    bool presentScheduled;
+    long lastPresentMs;
+    long framesDecoded;
+    long framesPresented;
+    long framesDeferred;
+    // latest pointer motion, waiting for the coalescing timer (main thread only)
+    bool hasPendingMotion;
+    int pendingMotionX;
+    int pendingMotionY;
+    int pendingMotionButtons;
+    // button state last sent to the host (decoder thread only)
+    int sentButtons;
+    // key events waiting to be sent one at a time (main thread only)
+    std::vector<VncKeyEvent> keySchedule;
+    int keyScheduleDelay;
+    size_t keyScheduleNext;
+    // connection thread: whether it's still going, whether endViewer has told
+    // it to give up, whether endAndDeleteViewer has left it the client and the
+    // viewer to clean up, and its wake pipe (bufferMutex guards the first three)
+    bool connectRunning;
+    bool stopConnect;
+    bool connectOwnsClient;
+    int connectWakePipe[2];
 
     // public methods
     //  instance
     void setObjectVisible ();
     bool fitsScroller ();
+    bool isScaled ();
+    void requestRemoteResize ();
+    void checkRemoteResize ();
+    void startDecoder ();
+    void stopDecoderThread ();
+    void wakeDecoder ();
+    void queueSend (const VncSendItem&);
+    bool sendNow (const VncSendItem&);
+    void sendPointerEvent (int, int, int, bool = false);
+    void flushPointerMotion ();
+    void sendKeyEvent (int, bool);
+    void sendKeyBatch (const std::vector<VncKeyEvent>&, int = 0);
+    void sendClientCutText (const std::string&);
+    void sendUpdateRequest (bool);
+    void setLowCostProfile (bool);
+    void updateViewport (bool);
+    void schedulePresent ();
+    void presentFrame ();
+    void flushSendQueue ();
+    void adaptEncodings ();
+    void applyEncodings ();
+    void startBenchmark ();
+    void benchmarkNext ();
+    void checkBenchmark ();
+    rfbBool allocFrameBuffer ();
+    void freeFrameBuffer ();
+    void freeScaledBuffer ();
+    rfbBool connectToHost ();
+    void setConnectState (int);
+    rfbBool listenForHost ();
+    void stopConnectThread ();
+    void closeConnectWake ();
     void endViewer ();
 
     //  static
     static void hideMainViewer ();
     static void endAndDeleteViewer (VncObject **);
     static void endAllViewers ();
+    static rfbBool handleMallocFrameBuffer (rfbClient *);
     static char * handlePassword (rfbClient *);
     static void handleCursorShapeChange (rfbClient *, int, int, int, int, int);
     static void libVncLogging (const char *, ...);
     static void parseErrorMessages(HostItem *, const char *);
-    static void checkVNCMessages (VncObject *);
+    static void * decoderThread (void *);
+    static void handleDecoderEvents (void *);
+    static void handlePresentTimer (void *);
+    static void handlePointerTimer (void *);
+    static void handleKeyTimer (void *);
     static void handleRemoteClipboardProc (rfbClient *, const char *, int);
+    static void handleGotFrameBufferUpdate (rfbClient *, int, int, int, int);
     static void handleFrameBufferUpdate (rfbClient *);
+    static void addDamageRect (std::vector<VncRect>&, VncRect);
     static void createVNCObject (HostItem *);
     static void createVNCListener ();
     static void * initVNCConnection (void *);
+    static rfbBool initConnectedClient (rfbClient *, HostItem *);
+    static bool startRFBConnection (HostItem *);
     static void masterMessageLoop ();
 };
 
@@ -129,6 +444,9 @@ public:
 private:
     int handle (int);
     void draw ();
+    void drawFrame (VncObject *, rfbClient *, HostItem *);
+    void drawBufferRect (const unsigned char *, int, int, int, int, int, int, int, int, int,
+        SVShmImage * shm = NULL);
     void sendCorrectedKeyEvent (const char *, const int, HostItem *, rfbClient *, bool);
 };
 
@@ -0,0 +1,361 @@
+/*
+ * xshm.cxx - part of SpiritVNC - FLTK
+ * 2016-2021 Will Brokenbourgh https://www.pismotek.com/brainout/
+ */
+
+/*
+ * (C) Will Brokenbourgh
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of
+ * conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of
+ * conditions and the following disclaimer in the documentation and/or other materials provided
+ * with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used
+ * to endorse or promote products derived from this software without specific prior written
+ * permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "xshm.h"
+
+#include <FL/Fl.H>
+#include <FL/x.H>
+#include <stdlib.h>
+
+#ifndef __APPLE__
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#endif
+
+
+#ifndef __APPLE__
+
+// -1 = not checked yet, 0 = no, 1 = yes
+static int nShmUsable = -1;
+static bool shmAttachFailed = false;
+
+
+/* catches the error XShmAttach raises on displays that can't share our memory */
+static int svShmErrorHandler (Display * display, XErrorEvent * event)
+{
+    (void) display;
+    (void) event;
+
+    shmAttachFailed = true;
+
+    return 0;
+}
+
+
+/* channel shift from a visual's channel mask */
+static int svMaskShift (unsigned long nMask)
+{
+    int nShift = 0;
+
+    if (nMask == 0)
+        return 0;
+
+    while ((nMask & 1) == 0)
+    {
+        nMask >>= 1;
+        nShift ++;
+    }
+
+    return nShift;
+}
+
+
+/* true if the display, visual and server can take shared memory images */
+bool svShmUsable ()
+{
+    if (nShmUsable != -1)
+        return (nShmUsable == 1);
+
+    SVPixelFormat fmt;
+
+    nShmUsable = 0;
+
+    if (svNativePixelFormat(fmt) == false)
+        return false;
+
+    #if FL_API_VERSION >= 10400
+    // fltk's own scaling would need the image scaled too
+    if (Fl::screen_scale(0) != 1.0f)
+        return false;
+    #endif
+
+    if (XShmQueryExtension(fl_display) == False)
+        return false;
+
+    nShmUsable = 1;
+
+    return true;
+}
+
+
+/*
+ * pixel layout of the display's visual, if it's a truecolor visual stored in
+ * 16 or 32-bit pixels that a vnc server can send us directly
+ */
+bool svNativePixelFormat (SVPixelFormat& fmt)
+{
+    if (fl_display == NULL)
+        fl_open_display();
+
+    if (fl_display == NULL || fl_visual == NULL || fl_visual->c_class != TrueColor)
+        return false;
+
+    // find how many bits x stores pixels of this depth in
+    int nFormats = 0;
+    int nBitsPerPixel = 0;
+    XPixmapFormatValues * formats = XListPixmapFormats(fl_display, &nFormats);
+
+    if (formats == NULL)
+        return false;
+
+    for (int i = 0; i < nFormats; i ++)
+        if (formats[i].depth == fl_visual->depth)
+            nBitsPerPixel = formats[i].bits_per_pixel;
+
+    XFree(formats);
+
+    if (nBitsPerPixel != 16 && nBitsPerPixel != 32)
+        return false;
+
+    fmt.bitsPerPixel = nBitsPerPixel;
+    fmt.depth = fl_visual->depth;
+    fmt.redShift = svMaskShift(fl_visual->red_mask);
+    fmt.greenShift = svMaskShift(fl_visual->green_mask);
+    fmt.blueShift = svMaskShift(fl_visual->blue_mask);
+    fmt.redMax = static_cast<int>(fl_visual->red_mask >> fmt.redShift);
+    fmt.greenMax = static_cast<int>(fl_visual->green_mask >> fmt.greenShift);
+    fmt.blueMax = static_cast<int>(fl_visual->blue_mask >> fmt.blueShift);
+    fmt.bigEndian = (ImageByteOrder(fl_display) == MSBFirst);
+
+    // rfb channel maxes are 16-bit and must be all ones
+    if (fmt.redMax < 1 || fmt.redMax > 65535 || (fmt.redMax & (fmt.redMax + 1)) != 0
+        || fmt.greenMax < 1 || fmt.greenMax > 65535 || (fmt.greenMax & (fmt.greenMax + 1)) != 0
+        || fmt.blueMax < 1 || fmt.blueMax > 65535 || (fmt.blueMax & (fmt.blueMax + 1)) != 0)
+        return false;
+
+    return true;
+}
+
+
+/*
+ * create a w x h shared memory image in the display's pixel format, packed
+ * so it can stand in for a plain buffer.  Returns NULL if shared memory can't be used
+ * (remote display, no extension, unsuitable visual, out of segments)
+ */
+SVShmImage * svShmCreate (int w, int h)
+{
+    SVPixelFormat fmt;
+
+    if (w < 1 || h < 1 || svShmUsable() == false || svNativePixelFormat(fmt) == false)
+        return NULL;
+
+    const int nBytesPerPixel = fmt.bitsPerPixel / 8;
+
+    SVShmImage * shm = new SVShmImage();
+
+    shm->shmInfo.shmid = -1;
+    shm->shmInfo.shmaddr = NULL;
+
+    shm->image = XShmCreateImage(fl_display, fl_visual->visual, fl_visual->depth, ZPixmap,
+        NULL, &shm->shmInfo, w, h);
+
+    // callers treat the image as a packed buffer
+    if (shm->image == NULL || shm->image->bits_per_pixel != fmt.bitsPerPixel
+        || shm->image->bytes_per_line != w * nBytesPerPixel)
+    {
+        svShmDestroy(shm);
+        return NULL;
+    }
+
+    shm->shmInfo.shmid = shmget(IPC_PRIVATE, shm->image->bytes_per_line * h, IPC_CREAT | 0600);
+
+    if (shm->shmInfo.shmid == -1)
+    {
+        svShmDestroy(shm);
+        return NULL;
+    }
+
+    shm->shmInfo.shmaddr = static_cast<char *>(shmat(shm->shmInfo.shmid, NULL, 0));
+
+    if (shm->shmInfo.shmaddr == reinterpret_cast<char *>(-1))
+    {
+        shm->shmInfo.shmaddr = NULL;
+        svShmDestroy(shm);
+        return NULL;
+    }
+
+    shm->shmInfo.readOnly = False;
+    shm->image->data = shm->shmInfo.shmaddr;
+
+    // a remote server fails the attach with an x error rather than a return value
+    XSync(fl_display, False);
+    XErrorHandler oldHandler = XSetErrorHandler(svShmErrorHandler);
+    shmAttachFailed = false;
+
+    Status attached = XShmAttach(fl_display, &shm->shmInfo);
+
+    XSync(fl_display, False);
+    XSetErrorHandler(oldHandler);
+
+    // the segment goes away once both sides detach
+    shmctl(shm->shmInfo.shmid, IPC_RMID, NULL);
+
+    if (attached == False || shmAttachFailed == true)
+    {
+        // don't keep trying on a display that can't do it
+        nShmUsable = 0;
+
+        shm->shmInfo.shmid = -1;
+        svShmDestroy(shm);
+        return NULL;
+    }
+
+    shm->data = reinterpret_cast<unsigned char *>(shm->shmInfo.shmaddr);
+    shm->w = w;
+    shm->h = h;
+
+    return shm;
+}
+
+
+/* detach and free a shared memory image */
+void svShmDestroy (SVShmImage * shm)
+{
+    if (shm == NULL)
+        return;
+
+    if (shm->data != NULL)
+    {
+        // let the server finish with the segment first
+        XShmDetach(fl_display, &shm->shmInfo);
+        XSync(fl_display, False);
+    }
+    else if (shm->shmInfo.shmid != -1)
+        shmctl(shm->shmInfo.shmid, IPC_RMID, NULL);
+
+    if (shm->shmInfo.shmaddr != NULL)
+        shmdt(shm->shmInfo.shmaddr);
+
+    if (shm->image != NULL)
+    {
+        shm->image->data = NULL;
+        XDestroyImage(shm->image);
+    }
+
+    delete shm;
+}
+
+
+/*
+ * copy part of a shared memory image to the current fltk drawing window.
+ * The server reads the segment later, so call svShmSync before the
+ * segment can change
+ */
+void svShmPut (SVShmImage * shm, int nSrcX, int nSrcY, int nDstX, int nDstY, int w, int h)
+{
+    if (shm == NULL || shm->image == NULL || w < 1 || h < 1)
+        return;
+
+    XShmPutImage(fl_display, fl_window, fl_gc, shm->image, nSrcX, nSrcY, nDstX, nDstY,
+        w, h, False);
+}
+
+
+/*
+ * wait for the server to finish reading every shared memory image put so
+ * far (one round trip, however many rectangles were put)
+ */
+void svShmSync ()
+{
+    XSync(fl_display, False);
+}
+
+
+/*
+ * copy part of a packed buffer that's already in the display's pixel format
+ * to the current fltk drawing window, with no conversion (remote displays,
+ * or when shared memory isn't available)
+ */
+void svNativePut (const unsigned char * buf, int nBufW, int nBufH, int nBytesPerPixel,
+    int nSrcX, int nSrcY, int nDstX, int nDstY, int w, int h)
+{
+    if (buf == NULL || fl_display == NULL || w < 1 || h < 1)
+        return;
+
+    XImage * image = XCreateImage(fl_display, fl_visual->visual, fl_visual->depth, ZPixmap, 0,
+        const_cast<char *>(reinterpret_cast<const char *>(buf)), nBufW, nBufH,
+        nBytesPerPixel * 8, nBufW * nBytesPerPixel);
+
+    if (image == NULL)
+        return;
+
+    XPutImage(fl_display, fl_window, fl_gc, image, nSrcX, nSrcY, nDstX, nDstY, w, h);
+
+    // the buffer isn't ours to free
+    image->data = NULL;
+    XDestroyImage(image);
+}
+
+#else
+
+// no X11 on macOS, so callers always take the fltk drawing path
+bool svShmUsable ()
+{
+    return false;
+}
+
+
+bool svNativePixelFormat (SVPixelFormat&)
+{
+    return false;
+}
+
+
+SVShmImage * svShmCreate (int, int)
+{
+    return NULL;
+}
+
+
+void svShmDestroy (SVShmImage * shm)
+{
+    delete shm;
+}
+
+
+void svShmPut (SVShmImage *, int, int, int, int, int, int)
+{
+}
+
+
+void svShmSync ()
+{
+}
+
+
+void svNativePut (const unsigned char *, int, int, int, int, int, int, int, int, int)
+{
+}
+
+#endif
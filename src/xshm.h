@@ -0,0 +1,100 @@
+/*
+ * xshm.h - part of SpiritVNC - FLTK
+ * 2016-2021 Will Brokenbourgh https://www.pismotek.com/brainout/
+ */
+
+/*
+ * (C) Will Brokenbourgh
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of
+ * conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of
+ * conditions and the following disclaimer in the documentation and/or other materials provided
+ * with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used
+ * to endorse or promote products derived from this software without specific prior written
+ * permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef XSHM_H
+#define XSHM_H
+
+#ifndef __APPLE__
+#include <X11/Xlib.h>
+#include <X11/extensions/XShm.h>
+#endif
+
+/* truecolor pixel layout of the display's visual */
+class SVPixelFormat
+{
+public:
+    SVPixelFormat () :
+        bitsPerPixel(32),
+        depth(24),
+        redShift(0),
+        greenShift(8),
+        blueShift(16),
+        redMax(255),
+        greenMax(255),
+        blueMax(255),
+        bigEndian(false)
+    {}
+
+    int bitsPerPixel;
+    int depth;
+    int redShift;
+    int greenShift;
+    int blueShift;
+    int redMax;
+    int greenMax;
+    int blueMax;
+    bool bigEndian;
+};
+
+/* X11 shared memory image (MIT-SHM) in the display's native pixel format */
+class SVShmImage
+{
+public:
+    SVShmImage () :
+        #ifndef __APPLE__
+        image(NULL),
+        #endif
+        data(NULL),
+        w(0),
+        h(0)
+    {}
+
+    #ifndef __APPLE__
+    XImage * image;
+    XShmSegmentInfo shmInfo;
+    #endif
+    unsigned char * data;
+    int w;
+    int h;
+};
+
+bool svShmUsable ();
+bool svNativePixelFormat (SVPixelFormat&);
+SVShmImage * svShmCreate (int, int);
+void svShmDestroy (SVShmImage *);
+void svShmPut (SVShmImage *, int, int, int, int, int, int);
+void svShmSync ();
+void svNativePut (const unsigned char *, int, int, int, int, int, int, int, int, int);
+
+#endif